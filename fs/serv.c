@@ -45,8 +45,12 @@ struct OpenFile opentab[MAXOPEN] = {
 	{ 0, 0, 1, 0 }
 };
 
-// Virtual address at which to receive page mappings containing client requests.
-union Fsipc *fsreq = (union Fsipc *)0x0ffff000;
+// Virtual address at which to receive page mappings containing client
+// requests.  There is room for two pages, for FSREQ_CHANNEL.
+union Fsipc *fsreq = (union Fsipc *)0x0fffe000;
+
+// Virtual address at which to build the pages of large read replies.
+#define READVA		(FILEVA + MAXOPEN * PGSIZE)
 
 void
 serve_init(void)
@@ -192,6 +196,43 @@ serve_read(envid_t envid, union Fsipc *ipc)
 }
 
 
+// Like serve_read, for reads too big to come back in a message: read at
+// most req->req_n bytes, up to IPC_MAXPAGES pages' worth, into fresh
+// pages at READVA, and hand those to the caller in the reply by setting
+// *pg_store and *npages_store.  The pages must be fresh every time,
+// since the last caller may still have the previous ones mapped.
+// Returns the number of bytes read, or < 0 on error.
+static int
+serve_read_pages(envid_t envid, struct Fsreq_read *req,
+		 void **pg_store, int *npages_store)
+{
+	struct OpenFile *o;
+	size_t n = 0;
+	int i, r;
+
+	if (debug)
+		cprintf("serve_read_pages %08x %08x %08x\n", envid, req->req_fileid, req->req_n);
+
+	if ((r = openfile_lookup(envid, req->req_fileid, &o)) < 0)
+		return r;
+
+	if (o->o_fd->fd_offset < o->o_file->f_size)
+		n = MIN(req->req_n, o->o_file->f_size - o->o_fd->fd_offset);
+	n = MIN(n, IPC_MAXPAGES * PGSIZE);
+	for (i = 0; i < ROUNDUP(n, PGSIZE) / PGSIZE; i++)
+		if ((r = sys_page_alloc(0, (void *) (READVA + i * PGSIZE),
+					PTE_P|PTE_U|PTE_W)) < 0)
+			return r;
+	if ((r = file_read(o->o_file, (void *) READVA, n,
+			   o->o_fd->fd_offset)) < 0)
+		return r;
+
+	o->o_fd->fd_offset += r;
+	*pg_store = (void *) READVA;
+	*npages_store = ROUNDUP(r, PGSIZE) / PGSIZE;
+	return r;
+}
+
 
 // Stat ipc->stat.req_fileid.  Return the file's struct Stat to the
 // caller in ipc->statRet.
@@ -234,44 +275,247 @@ fshandler handlers[] = {
 };
 #define NHANDLERS (sizeof(handlers)/sizeof(handlers[0]))
 
+// How many bytes of the reply to a request that came without a page
+// go back in the reply message.
+static size_t
+serve_retlen(uint32_t req, int r)
+{
+	switch (req) {
+	case FSREQ_READ:
+		return r > 0 ? r : 0;
+	case FSREQ_STAT:
+		return sizeof(struct Fsret_stat);
+	default:
+		return 0;
+	}
+}
+
+// Run the handler for request 'req' from 'envid' on the arguments in 'ipc'.
+static int
+serve_dispatch(envid_t envid, uint32_t req, union Fsipc *ipc)
+{
+	if (req < NHANDLERS && handlers[req])
+		return handlers[req](envid, ipc);
+	cprintf("Invalid request code %d from %08x\n", req, envid);
+	return -E_INVAL;
+}
+
+// Clients can also send small requests over a channel (see lib/chan.c)
+// instead of by IPC.  Each channel's two pages are mapped at their own
+// spot from CHANVA on.  A channel wakes us with notification bit
+// FSNOTIFY_CHAN (see sys_ipc_notify).
+#define MAXCHAN		64
+#define CHANVA		(READVA + IPC_MAXPAGES * PGSIZE)
+
+struct FsChan {
+	envid_t fc_env;		// client, or 0 if this slot is free
+	struct Chan fc_chan;
+};
+
+struct FsChan chantab[MAXCHAN];
+
+// Set up a channel for 'envid' on the two pages it sent us at 'pg'.
+// Returns 0 on success, < 0 on error.
+static int
+serve_channel(envid_t envid, void *pg)
+{
+	void *va;
+	int i, r;
+
+	for (i = 0; i < MAXCHAN; i++)
+		if (!chantab[i].fc_env)
+			break;
+	if (i == MAXCHAN)
+		return -E_MAX_OPEN;
+
+	va = (void *) (CHANVA + i * 2 * PGSIZE);
+	if ((r = sys_page_map(0, pg, 0, va, PTE_P|PTE_U|PTE_W)) < 0
+	    || (r = sys_page_map(0, pg + PGSIZE, 0, va + PGSIZE,
+				 PTE_P|PTE_U|PTE_W)) < 0) {
+		sys_page_unmap(0, va);
+		return r;
+	}
+	chan_attach(&chantab[i].fc_chan, va);
+	chantab[i].fc_env = envid;
+	return 0;
+}
+
+// Serve the requests waiting on channel 'fc', for as long as there is
+// room for the replies.  Returns the number of requests served.
+static int
+serve_chan(struct FsChan *fc)
+{
+	static union Fsipc ipc;
+	struct ChanMsg *m, *out;
+	uint32_t req;
+	size_t len;
+	int n, r;
+
+	for (n = 0; (m = chan_recv_begin(&fc->fc_chan))
+		     && (out = chan_send_begin(&fc->fc_chan)); n++) {
+		req = m->cm_value;
+		memmove(&ipc, m->cm_data, MIN(m->cm_len, CHAN_MSGDATA));
+		chan_recv_end(&fc->fc_chan);
+
+		if (debug)
+			cprintf("fs chan req %d from %08x\n", req, fc->fc_env);
+
+		// The reply must fit in a message, and there's no room
+		// for a path.
+		if (req == FSREQ_READ)
+			ipc.read.req_n = MIN(ipc.read.req_n, CHAN_MSGDATA);
+		if (req == FSREQ_OPEN || req == FSREQ_REMOVE)
+			r = -E_INVAL;
+		else
+			r = serve_dispatch(fc->fc_env, req, &ipc);
+
+		len = serve_retlen(req, r);
+		out->cm_value = r;
+		out->cm_len = len;
+		memmove(out->cm_data, &ipc, len);
+		chan_send_end(&fc->fc_chan);
+	}
+	return n;
+}
+
+// Make one pass over all the channels, closing those whose client has
+// gone away (leaving us the only mapping).
+// Returns the number of requests served.
+static int
+serve_chans(void)
+{
+	struct FsChan *fc;
+	int n = 0;
+
+	for (fc = chantab; fc < chantab + MAXCHAN; fc++) {
+		if (!fc->fc_env)
+			continue;
+		if (pageref(fc->fc_chan.ch_in) == 1) {
+			sys_page_unmap(0, fc->fc_chan.ch_in);
+			sys_page_unmap(0, fc->fc_chan.ch_out);
+			fc->fc_env = 0;
+			continue;
+		}
+		n += serve_chan(fc);
+	}
+	return n;
+}
+
+// Before sleeping in IPC receive, ask every channel to notify us of its
+// next request, or, if 'arm' is 0, take that back once awake.
+// Returns 1 if a channel already has a request we can serve, in which
+// case we shouldn't go to sleep.
+static int
+serve_chans_arm(bool arm)
+{
+	struct FsChan *fc;
+	int ready = 0;
+
+	for (fc = chantab; fc < chantab + MAXCHAN; fc++) {
+		if (!fc->fc_env)
+			continue;
+		if (!arm)
+			chan_disarm(&fc->fc_chan);
+		else if (chan_arm(&fc->fc_chan) && chan_send_begin(&fc->fc_chan))
+			ready = 1;
+	}
+	return ready;
+}
+
 void
 serve(void)
 {
-	uint32_t req, whom;
-	int perm, r;
+	// Requests that come as message words rather than a page
+	// are unpacked here.
+	static union Fsipc shortreq;
+	static struct IpcMsg reply;
+	union Fsipc *ipc;
+	uint32_t req, whom = 0;
+	int perm = 0, npages, r;
+	bool fromcall = 0;
 	void *pg;
 
 	while (1) {
-		perm = 0;
-		req = ipc_recv((int32_t *) &whom, fsreq, &perm);
+		// Work through the channels until they are all quiet.
+		while (serve_chans() > 0 || serve_chans_arm(1))
+			serve_chans_arm(0);
+
+		// A client that used ipc_send rather than ipc_call may not
+		// be receiving yet, and ipc_reply_wait would drop its reply:
+		// send that one on its own, the way we used to.
+		if (whom && !fromcall) {
+			sys_ipc_send(whom, reply.im_value, reply.im_srcva,
+				     reply.im_perm);
+			whom = 0;
+		}
+
+		// Answer the last request (if any) and wait for the next
+		// in one system call.  A channel that gets a request
+		// meanwhile wakes us with a notification (from envid 0).
+		req = ipc_reply_wait(whom, &reply, (int32_t *) &whom, fsreq, 2,
+				     &perm, -1);
+		fromcall = thisenv->env_ipc_fromcall;
+		serve_chans_arm(0);
+		if (!whom)
+			continue;
 		if (debug)
 			cprintf("fs req %d from %08x [page %08x: %s]\n",
 				req, whom, uvpt[PGNUM(fsreq)], fsreq);
 
-		// All requests must contain an argument page
-		if (!(perm & PTE_P)) {
-			cprintf("Invalid request from %08x: no argument page\n",
-				whom);
-			continue; // just leave it hanging...
+		if (perm & PTE_P)
+			ipc = fsreq;
+		else {
+			// Short requests can't carry a path.
+			ipc = &shortreq;
+			memmove(ipc, (void *) thisenv->env_ipc_msg,
+				thisenv->env_ipc_msglen * sizeof(uint32_t));
+			if (req == FSREQ_OPEN || req == FSREQ_REMOVE
+			    || req == FSREQ_CHANNEL) {
+				cprintf("Invalid request from %08x: no argument page\n",
+					whom);
+				whom = 0;
+				continue; // just leave it hanging...
+			}
 		}
 
 		pg = NULL;
+		npages = 1;
 		if (req == FSREQ_OPEN) {
 			r = serve_open(whom, (struct Fsreq_open*)fsreq, &pg, &perm);
-		} else if (req < NHANDLERS && handlers[req]) {
-			r = handlers[req](whom, fsreq);
-		} else {
-			cprintf("Invalid request code %d from %08x\n", req, whom);
+		} else if (req == FSREQ_CHANNEL) {
 			r = -E_INVAL;
+			if (thisenv->env_ipc_npages == 2)
+				r = serve_channel(whom, fsreq);
+		} else if (req == FSREQ_READ && ipc == &shortreq
+			   && ipc->read.req_n > sizeof(reply.im_words)) {
+			// Too big for the reply message: send pages instead.
+			r = serve_read_pages(whom, &ipc->read, &pg, &npages);
+			perm = PTE_P|PTE_U|PTE_W;
+		} else
+			r = serve_dispatch(whom, req, ipc);
+
+		reply.im_value = r;
+		reply.im_srcva = pg ? pg : (void *) UTOP;
+		reply.im_perm = perm;
+		reply.im_npages = npages;
+		reply.im_nwords = 0;
+		if (ipc != &shortreq) {
+			sys_page_unmap(0, fsreq);
+			if (thisenv->env_ipc_npages > 1)
+				sys_page_unmap(0, (void *) fsreq + PGSIZE);
+		} else if (!pg) {
+			size_t len = serve_retlen(req, r);
+			reply.im_nwords = ROUNDUP(len, sizeof(uint32_t)) / sizeof(uint32_t);
+			memmove(reply.im_words, ipc, len);
 		}
-		ipc_send(whom, r, pg, perm);
-		sys_page_unmap(0, fsreq);
 	}
 }
 
 void
 umain(int argc, char **argv)
 {
+	int r;
+
 	static_assert(sizeof(struct File) == 256);
 	binaryname = "fs";
 	cprintf("FS is running\n");
@@ -282,6 +526,10 @@ umain(int argc, char **argv)
 
 	serve_init();
 	fs_init();
+
+	// Let clients find us.
+	if ((r = sys_service_register("fs")) < 0)
+		panic("registering as fs: %e", r);
 	serve();
 }
 
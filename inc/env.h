@@ -6,6 +6,8 @@
 #include <inc/types.h>
 #include <inc/trap.h>
 #include <inc/memlayout.h>
+#include <inc/futex.h>
+#include <inc/ipc.h>
 
 typedef int32_t envid_t;
 
@@ -44,8 +46,21 @@ enum EnvType {
 	ENV_TYPE_FS,		// File system server
 };
 
+// An environment's place in one futex wait queue (see kern/futex.c).
+struct FutexNode {
+	physaddr_t fn_key;		// Physical address waited on, or 0
+	struct FutexNode *fn_link;	// Next node in the same hash bucket
+	struct Env *fn_env;		// Environment doing the waiting
+};
+
 struct Env {
-	struct Trapframe env_tf;	// Saved registers
+	struct Trapframe env_tf;	// Saved registers; while the env is
+					// ENV_RUNNING, its CPU's traps write
+					// here without the kernel lock, so
+					// only that CPU may touch it
+	uintptr_t env_kstack;		// Kernel stack to switch to after a
+					// trap; must follow env_tf (see
+					// _alltraps)
 	struct Env *env_link;		// Next free Env
 	envid_t env_id;			// Unique environment identifier
 	envid_t env_parent_id;		// env_id of this env's parent
@@ -56,16 +71,53 @@ struct Env {
 
 	// Address space
 	pde_t *env_pgdir;		// Kernel virtual address of page dir
+	struct Vdso *env_vdso;		// Kernel virtual address of UVDSO page
+	struct Ring *env_ring;		// Kernel virtual address of syscall ring
+	void *env_ring_va;		// Where we registered the ring
+	struct TraceRing *env_trace;	// Kernel VA of tracer's ring, or NULL
+
+	// FPU state (see kern/fpu.c)
+	void *env_fpu;			// Kernel VA of FXSAVE area, or NULL
+	int env_fpu_cpu;		// CPU whose FPU matches env_fpu, or -1
 
 	// Exception handling
 	void *env_pgfault_upcall;	// Page fault upcall entry point
 
 	// Lab 4 IPC
 	bool env_ipc_recving;		// Env is blocked receiving
-	void *env_ipc_dstva;		// VA at which to map received page
+	void *env_ipc_dstva;		// VA at which to map received pages
+	int env_ipc_dstpages;		// Most pages to map at env_ipc_dstva
 	uint32_t env_ipc_value;		// Data value sent to us
 	envid_t env_ipc_from;		// envid of the sender
 	int env_ipc_perm;		// Perm of page mapping received
+	int env_ipc_npages;		// Number of pages received
+	envid_t env_ipc_waitfrom;	// If nonzero, only receive from this env
+	bool env_ipc_fromcall;		// Sender is in sys_ipc_call, awaiting
+					//	our sys_ipc_reply_wait
+	int env_ipc_msglen;		// Number of words received in env_ipc_msg
+	uint32_t env_ipc_msg[IPC_MSGWORDS];	// Payload received
+	unsigned env_ipc_deadline;	// time_msec() to time out at, or 0
+	uint32_t env_ipc_notify;	// Notification bits not yet received
+
+	// Blocking IPC send (see kern/ipc.c)
+	struct Env *env_ipc_sendq;	// Senders blocked on us, oldest first
+	struct Env *env_ipc_sendlink;	// Next sender in the same queue
+	envid_t env_ipc_sendto;		// Env we're blocked sending to, or 0
+	uint32_t env_ipc_sendval;	// Value we're sending
+	void *env_ipc_sendva;		// Pages we're sending, if < UTOP
+	int env_ipc_sendperm;		// Perm of the pages we're sending
+	int env_ipc_sendpages;		// Number of pages at env_ipc_sendva
+	int env_ipc_sendlen;		// Number of words in env_ipc_sendmsg
+	uint32_t env_ipc_sendmsg[IPC_MSGWORDS];	// Payload we're sending
+
+	// Futex wait queues
+	struct FutexNode env_futex[FUTEX_NWAIT];	// One per word waited on
+	unsigned env_futex_deadline;	// time_msec() to time out at, or 0
+
+	// Window other environments may hand pages to (sys_page_accept)
+	uintptr_t env_accept_va;	// Start of the window
+	size_t env_accept_len;		// Length in bytes, or 0 if closed
+	uintptr_t env_accept_key;	// Senders must share the page here
 };
 
 #endif // !JOS_INC_ENV_H
@@ -26,6 +26,11 @@ enum {
 	E_NOT_EXEC	= 14,	// File not a valid executable
 	E_NOT_SUPP	= 15,	// Operation not supported
 
+	E_AGAIN		= 16,	// Value changed before the caller could block
+	E_TIMEOUT	= 17,	// Timed out waiting
+	E_NAME_EXISTS	= 18,	// Service name already registered
+	E_NO_PERM	= 19,	// Not allowed to do that
+
 	MAXERROR
 };
 
@@ -11,6 +11,7 @@
 struct Fd;
 struct Stat;
 struct Dev;
+struct FutexWait;
 
 // Per-device-class file descriptor operations
 struct Dev {
@@ -21,6 +22,24 @@ struct Dev {
 	int (*dev_close)(struct Fd *fd);
 	int (*dev_stat)(struct Fd *fd, struct Stat *stat);
 	int (*dev_trunc)(struct Fd *fd, off_t length);
+	// Which of 'events' (POLLIN, POLLOUT), plus POLLHUP, are ready now?
+	// If none, fill in '*w' with a word that will change and be woken
+	// once that may no longer be true, or set w->fw_addr to 0 if the
+	// device can only be checked again later.  Devices without
+	// dev_poll never block, so are always ready.
+	int (*dev_poll)(struct Fd *fd, int events, struct FutexWait *w);
+};
+
+// Events for poll()
+#define POLLIN		0x001		// Reading won't block
+#define POLLOUT		0x004		// Writing won't block
+#define POLLHUP		0x010		// The other end is gone
+#define POLLNVAL	0x020		// Not an open file descriptor
+
+struct PollFd {
+	int pf_fd;		// File descriptor to watch
+	int pf_events;		// Events we care about
+	int pf_revents;		// Events that are ready (set by poll)
 };
 
 struct FdFile {
@@ -70,9 +70,16 @@ enum {
 	FSREQ_STAT,
 	FSREQ_FLUSH,
 	FSREQ_REMOVE,
-	FSREQ_SYNC
+	FSREQ_SYNC,
+	// Channel passes the two pages of a client's channel (see chan.c),
+	// over which it then sends small requests instead of by IPC
+	FSREQ_CHANNEL
 };
 
+// Notification bit (see sys_ipc_notify) a client's channel wakes the
+// file server with
+#define FSNOTIFY_CHAN	0x1
+
 union Fsipc {
 	struct Fsreq_open {
 		char req_path[MAXPATHLEN];
@@ -0,0 +1,19 @@
+#ifndef JOS_INC_FUTEX_H
+#define JOS_INC_FUTEX_H
+
+#include <inc/types.h>
+
+// Most words one sys_futex_waitv call can sleep on;
+// enough for poll() to watch every file descriptor.
+#define FUTEX_NWAIT	32
+
+// One word for sys_futex_waitv to watch.  The caller sleeps only while
+// *fw_addr == fw_expected and, if fw_refs is nonzero, the page holding
+// fw_addr is mapped exactly fw_refs times (as in sys_futex_wait_pageref).
+struct FutexWait {
+	const volatile uint32_t *fw_addr;
+	uint32_t fw_expected;
+	int fw_refs;
+};
+
+#endif	// !JOS_INC_FUTEX_H
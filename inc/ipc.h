@@ -0,0 +1,32 @@
+#ifndef JOS_INC_IPC_H
+#define JOS_INC_IPC_H
+
+#include <inc/types.h>
+
+// Most words of payload one IPC message can carry without a page.
+#define IPC_MSGWORDS	64
+
+// Most pages one IPC message can carry.
+#define IPC_MAXPAGES	32
+
+// Longest name a server can register under, counting the '\0'.
+#define SERVICE_NAMELEN	32
+
+// An IPC message for sys_ipc_call and sys_ipc_reply_wait.  Besides the
+// value and optional page that every IPC carries, up to IPC_MSGWORDS
+// words of payload are copied through the kernel into the receiver's
+// struct Env (env_ipc_msg), where it can read them through 'thisenv'.
+// Small requests and replies need no page mapping at all this way.
+// Big ones can send a run of up to IPC_MAXPAGES pages starting at
+// im_srcva, which the receiver gets mapped contiguously at its dstva
+// (as many of them as fit its receive window; see env_ipc_npages).
+struct IpcMsg {
+	uint32_t im_value;		// Value, as for sys_ipc_try_send
+	void *im_srcva;			// Pages to send, or >= UTOP for none
+	int im_perm;			// Permissions for those pages
+	int im_npages;			// Number of pages at im_srcva
+	int im_nwords;			// Number of im_words to send
+	uint32_t im_words[IPC_MSGWORDS];
+};
+
+#endif	// !JOS_INC_IPC_H
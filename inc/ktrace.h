@@ -0,0 +1,45 @@
+#ifndef JOS_INC_KTRACE_H
+#define JOS_INC_KTRACE_H
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+
+// Kernel event tracing (see kern/ktrace.c).  While tracing is on, each
+// CPU logs timestamped kernel events into a ring of its own, which the
+// monitor's "ktrace" command prints, and sys_ktrace_map maps read-only
+// into an environment for offline analysis.
+//
+// A CPU's ring is KTRACE_NPAGES pages of struct KtraceEvent, and the
+// n'th event it logs (counting from 0) goes in slot n % KTRACE_NEVENTS,
+// with ke_seq n + 1.  The kernel zeroes ke_seq while it rewrites a
+// slot, so a reader that sees the same non-zero ke_seq before and after
+// copying a slot has a consistent event.
+
+#define KTRACE_NPAGES	4
+#define KTRACE_NEVENTS	(KTRACE_NPAGES * PGSIZE / sizeof(struct KtraceEvent))
+
+enum {
+	KT_SWITCH = 1,		// env_run: switching from ke_env (0 if none)
+				//	to arg0
+	KT_IDLE,		// sched_halt: nothing to run, CPU halting
+	KT_PGFAULT,		// arg0 = fault va, arg1 = eip, arg2 = error code
+	KT_IPC_SEND,		// arg0 = to, arg1 = value, arg2 = system call
+	KT_IPC_RECV,		// Starts receiving: arg0 = timeout, arg1 = dstva,
+				//	arg2 = system call
+	KT_ENV_CREATE,		// arg0 = new environment, arg1 = parent
+	KT_ENV_DESTROY,		// arg0 = environment being freed
+	KT_LOCK_SPIN,		// Spun for a lock: arg0 = lock address,
+				//	arg1 = cycles spun
+	NKTRACE
+};
+
+struct KtraceEvent {
+	volatile uint32_t ke_seq;	// Event's number on its CPU, plus 1
+	uint16_t ke_type;		// KT_*
+	uint16_t ke_cpu;
+	uint64_t ke_tsc;		// When it happened
+	envid_t ke_env;			// curenv then, or 0
+	uint32_t ke_arg[3];
+};
+
+#endif	// !JOS_INC_KTRACE_H
@@ -20,6 +20,10 @@
 #include <inc/fs.h>
 #include <inc/fd.h>
 #include <inc/args.h>
+#include <inc/time.h>
+#include <inc/vdso.h>
+#include <inc/ring.h>
+#include <inc/ktrace.h>
 
 #define USED(x)		(void)(x)
 
@@ -31,6 +35,8 @@ extern const char *binaryname;
 extern const volatile struct Env *thisenv;
 extern const volatile struct Env envs[NENV];
 extern const volatile struct PageInfo pages[];
+extern const volatile struct TimePage timepage;
+extern const volatile struct Vdso vdso;
 
 // exit.c
 void	exit(void);
@@ -56,7 +62,33 @@ int	sys_page_map(envid_t src_env, void *src_pg,
 		     envid_t dst_env, void *dst_pg, int perm);
 int	sys_page_unmap(envid_t env, void *pg);
 int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
-int	sys_ipc_recv(void *rcv_pg);
+int	sys_ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
+int	sys_ipc_recv(void *rcv_pg, int timeout);
+int	sys_ipc_notify(envid_t to_env, uint32_t bits);
+int	sys_ipc_call(envid_t to_env, const struct IpcMsg *msg, void *rcv_pg,
+		     int rcv_npages, int timeout);
+int	sys_ipc_reply_wait(envid_t to_env, const struct IpcMsg *msg,
+			   void *rcv_pg, int rcv_npages, int timeout);
+int	sys_futex_wait(const volatile uint32_t *addr, uint32_t expected);
+int	sys_futex_wait_pageref(const volatile uint32_t *addr, uint32_t expected,
+			       int refs);
+int	sys_futex_wake(const volatile uint32_t *addr, int n);
+int	sys_page_accept(void *va, size_t len, void *keyva);
+int	sys_page_flip(void *srcva, envid_t dstenv, void *dstva, void *keyva,
+		      int perm);
+int	sys_futex_waitv(const struct FutexWait *w, int n, int timeout);
+unsigned int sys_time_msec(void);
+uint64_t sys_time_nsec(void);
+int	sys_service_register(const char *name);
+envid_t	sys_service_lookup(const char *name);
+int	sys_batch(struct SyscallDesc *d, int n, int flags);
+int	sys_ring_setup(void *va);
+int	sys_ring_enter(void);
+int	sys_env_stats(envid_t envid, struct EnvStats *stats);
+int	sys_env_trace(envid_t envid, void *va);
+int	sys_ktrace(int on);
+int	sys_ktrace_map(void *va);
+int	sys_perf_read(envid_t envid, struct PerfCounts *pc);
 
 // This must be inlined.  Exercise for reader: why?
 static __inline envid_t __attribute__((always_inline))
@@ -74,12 +106,27 @@ sys_exofork(void)
 // ipc.c
 void	ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
+int32_t ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+			 int timeout);
+int32_t ipc_call(envid_t to_env, uint32_t value, void *pg, int perm,
+		 void *rcv_pg, int *perm_store);
+int32_t ipc_callmsg(envid_t to_env, const struct IpcMsg *msg,
+		    void *rcv_pg, int rcv_npages, int *perm_store,
+		    int timeout);
+int32_t ipc_reply_wait(envid_t to_env, const struct IpcMsg *msg,
+		       envid_t *from_env_store, void *rcv_pg, int rcv_npages,
+		       int *perm_store, int timeout);
 envid_t	ipc_find_env(enum EnvType type);
+envid_t	ipc_lookup(const char *name);
 
 // fork.c
 #define	PTE_SHARE	0x400
+#define	PTE_COW		0x800	// copy-on-write; see fork.c
+#define	PTE_NOCOPY	0x200	// fork leaves it out of the child
 envid_t	fork(void);
 envid_t	sfork(void);	// Challenge!
+int	cow_ok(void);
+int	cow_ready(void);
 
 // fd.c
 int	close(int fd);
@@ -90,6 +137,7 @@ void	close_all(void);
 ssize_t	readn(int fd, void *buf, size_t nbytes);
 int	dup(int oldfd, int newfd);
 int	fstat(int fd, struct Stat *statbuf);
+int	poll(struct PollFd *fds, int nfds, int timeout);
 int	stat(const char *path, struct Stat *statbuf);
 
 // file.c
@@ -116,9 +164,84 @@ int	opencons(void);
 int	pipe(int pipefds[2]);
 int	pipeisclosed(int pipefd);
 
+// time.c
+uint64_t time_nsec(void);
+
+// vdso.c
+envid_t	getenvid(void);
+int	getcpu(void);
+
 // wait.c
 void	wait(envid_t env);
 
+// sync.c
+// These live in memory shared between environments (a PTE_SHARE page)
+// and block in the kernel via sys_futex_wait when contended.
+struct Mutex {
+	volatile uint32_t m_state;	// 0 unlocked, 1 locked, 2 contended
+};
+
+struct Cond {
+	volatile uint32_t c_seq;	// Bumped by every signal/broadcast
+};
+
+void	mutex_init(struct Mutex *m);
+void	mutex_lock(struct Mutex *m);
+int	mutex_trylock(struct Mutex *m);
+void	mutex_unlock(struct Mutex *m);
+void	cond_init(struct Cond *c);
+void	cond_wait(struct Cond *c, struct Mutex *m);
+void	cond_signal(struct Cond *c);
+void	cond_broadcast(struct Cond *c);
+
+// chan.c
+// A channel is two of these rings on a pair of shared pages, one for
+// each direction.  See chan.c.
+#define CHAN_NSLOTS	8	// Messages per ring; must be a power of 2
+#define CHAN_MSGDATA	480	// Most bytes of data per message
+
+struct ChanMsg {
+	uint32_t cm_value;		// Request type, reply status, etc.
+	uint32_t cm_len;		// Bytes used in cm_data
+	uint8_t cm_data[CHAN_MSGDATA];
+};
+
+struct ChanRing {
+	volatile uint32_t cr_head;	// Next message to receive
+	volatile uint32_t cr_tail;	// Next slot to send into
+	uint32_t cr_waiting;		// The consumer may be asleep
+	struct ChanMsg cr_msg[CHAN_NSLOTS];
+};
+
+struct Chan {
+	struct ChanRing *ch_out;	// Ring we send on
+	struct ChanRing *ch_in;		// Ring we receive on
+	envid_t ch_wakeenv;		// If set, wake the other end by IPC...
+	uint32_t ch_wakebits;		// ...notifying it of these bits
+};
+
+int	chan_create(struct Chan *c, void *va, int perm);
+void	chan_attach(struct Chan *c, void *va);
+struct ChanMsg *chan_send_begin(struct Chan *c);
+void	chan_send_end(struct Chan *c);
+struct ChanMsg *chan_recv_begin(struct Chan *c);
+void	chan_recv_end(struct Chan *c);
+void	chan_recv_wait(struct Chan *c);
+void	chan_wake_by_ipc(struct Chan *c, envid_t envid, uint32_t bits);
+int	chan_arm(struct Chan *c);
+void	chan_disarm(struct Chan *c);
+
+// ring.c
+int	ring_init(void *va);
+struct RingSqe *ring_get_sqe(void);
+int	ring_prep(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3,
+		  uint32_t a4, uint32_t a5, uint32_t data);
+void	ring_submit(void);
+int	ring_enter(void);
+struct RingCqe *ring_peek_cqe(void);
+void	ring_cqe_seen(void);
+struct RingCqe *ring_wait_cqe(void);
+
 /* File open modes */
 #define	O_RDONLY	0x0000		/* open for reading only */
 #define	O_WRONLY	0x0001		/* open for writing only */
@@ -48,14 +48,16 @@
  * ULIM, MMIOBASE -->  +------------------------------+ 0xef800000
  *                     |  Cur. Page Table (User R-)   | R-/R-  PTSIZE
  *    UVPT      ---->  +------------------------------+ 0xef400000
- *                     |          RO PAGES            | R-/R-  PTSIZE
+ *                     |        RO Clock Page         | R-/R-  PGSIZE
+ *    UTIME     ---->  +------------------------------+ 0xef3ff000
+ *                     |          RO PAGES            | R-/R-  PTSIZE-PGSIZE
  *    UPAGES    ---->  +------------------------------+ 0xef000000
  *                     |           RO ENVS            | R-/R-  PTSIZE
  * UTOP,UENVS ------>  +------------------------------+ 0xeec00000
  * UXSTACKTOP -/       |     User Exception Stack     | RW/RW  PGSIZE
  *                     +------------------------------+ 0xeebff000
- *                     |       Empty Memory (*)       | --/--  PGSIZE
- *    USTACKTOP  --->  +------------------------------+ 0xeebfe000
+ *                     |   RO Per-Env Data (UVDSO)    | R-/R-  PGSIZE
+ * USTACKTOP,UVDSO ->  +------------------------------+ 0xeebfe000
  *                     |      Normal User Stack       | RW/RW  PGSIZE
  *                     +------------------------------+ 0xeebfd000
  *                     |                              |
@@ -110,6 +112,8 @@
 
 // User read-only virtual page table (see 'uvpt' below)
 #define UVPT		(ULIM - PTSIZE)
+// Read-only clock page (struct TimePage), the top page of UPAGES' slot
+#define UTIME		(UVPT - PGSIZE)
 // Read-only copies of the Page structures
 #define UPAGES		(UVPT - PTSIZE)
 // Read-only copies of the global env structures
@@ -123,7 +127,9 @@
 #define UTOP		UENVS
 // Top of one-page user exception stack
 #define UXSTACKTOP	UTOP
-// Next page left invalid to guard against exception stack overflow; then:
+// Next page is the environment's read-only data page (struct Vdso),
+// which also guards against exception stack overflow; then:
+#define UVDSO		(UTOP - 2*PGSIZE)
 // Top of normal user stack
 #define USTACKTOP	(UTOP - 2*PGSIZE)
 
@@ -0,0 +1,26 @@
+#ifndef JOS_INC_PERF_H
+#define JOS_INC_PERF_H
+
+#include <inc/types.h>
+
+// Hardware performance counters (see kern/perf.c).  Every CPU that
+// has the counters for it counts each event below, in user mode and in
+// the kernel alike, and the kernel charges the counts to whichever
+// environment was running at the time.
+
+enum {
+	PERF_CYCLES = 0,	// Unhalted core cycles
+	PERF_INSTRUCTIONS,	// Instructions retired
+	PERF_CACHE_MISSES,	// Last-level cache misses
+	PERF_TLB_MISSES,	// Data TLB load misses that walked the page tables
+	PERF_NEVENTS
+};
+
+// What sys_perf_read returns.
+struct PerfCounts {
+	uint32_t pc_valid;			// Bit i set if event i is counted
+	uint64_t pc_env[PERF_NEVENTS];		// The environment's counts
+	uint64_t pc_all[PERF_NEVENTS];		// The whole system's
+};
+
+#endif	// !JOS_INC_PERF_H
@@ -0,0 +1,48 @@
+#ifndef JOS_INC_RING_H
+#define JOS_INC_RING_H
+
+#include <inc/types.h>
+
+// Asynchronous system calls.  An environment registers a page holding
+// a struct Ring with sys_ring_setup, queues requests on its submission
+// ring, and collects their results from its completion ring.  The
+// kernel works through the submission ring every time the environment
+// traps into it, for whatever reason, and on sys_ring_enter, as long
+// as the page is mapped nowhere else: requests run with the owner's
+// rights.
+//
+// Only non-blocking calls may be queued: sys_page_alloc, sys_page_map,
+// sys_page_unmap, and sys_ipc_try_send.  Anything else completes with
+// -E_INVAL.  A send whose receiver isn't waiting yet stays at the head
+// of the ring and is tried again on the next trap, so sends are
+// delivered in order, and requests queued behind one wait for it.
+//
+// Heads and tails count up forever, as in struct ChanRing; the user
+// owns sq_tail and cq_head, the kernel sq_head and cq_tail.  The kernel
+// only takes a request when it has a completion slot free for it.
+
+#define RING_NSLOTS	64	// must be a power of 2
+
+// A queued system call: sqe_num and sqe_args as for struct SyscallDesc.
+// The kernel hands sqe_data back in the completion, untouched.
+struct RingSqe {
+	uint32_t sqe_num;
+	uint32_t sqe_args[5];
+	uint32_t sqe_data;
+};
+
+struct RingCqe {
+	uint32_t cqe_data;		// The request's sqe_data
+	int32_t cqe_ret;		// What the system call returned
+};
+
+struct Ring {
+	volatile uint32_t r_sq_head;	// Next request the kernel takes
+	volatile uint32_t r_sq_tail;	// Next request slot to fill
+	volatile uint32_t r_cq_head;	// Next completion to collect
+	volatile uint32_t r_cq_tail;	// Next completion slot to fill
+	struct RingSqe r_sq[RING_NSLOTS];
+	struct RingCqe r_cq[RING_NSLOTS];
+};
+
+#endif	// !JOS_INC_RING_H
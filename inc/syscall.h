@@ -1,6 +1,8 @@
 #ifndef JOS_INC_SYSCALL_H
 #define JOS_INC_SYSCALL_H
 
+#include <inc/types.h>
+
 /* system call numbers */
 enum {
 	SYS_cputs = 0,
@@ -17,7 +19,45 @@ enum {
 	SYS_yield,
 	SYS_ipc_try_send,
 	SYS_ipc_recv,
+	SYS_futex_wait,
+	SYS_futex_wake,
+	SYS_page_accept,
+	SYS_page_flip,
+	SYS_futex_waitv,
+	SYS_time_msec,
+	SYS_ipc_send,
+	SYS_ipc_call,
+	SYS_ipc_reply_wait,
+	SYS_service_register,
+	SYS_service_lookup,
+	SYS_ipc_notify,
+	SYS_time_nsec,
+	SYS_batch,
+	SYS_ring_setup,
+	SYS_ring_enter,
+	SYS_env_stats,
+	SYS_env_trace,
+	SYS_ktrace,
+	SYS_ktrace_map,
+	SYS_perf_read,
 	NSYSCALLS
 };
 
+const char *syscall_name(uint32_t num);
+
+// Most system calls one sys_batch call can run.
+#define BATCH_MAX	64
+
+// sys_batch flags
+#define BATCH_STOP	0x1	// Stop at the first call that fails
+
+// One system call for sys_batch to run: sd_num and sd_args are what
+// would go in %eax and %edx, %ecx, %ebx, %edi, %esi, and the kernel
+// stores the call's return value in sd_ret.
+struct SyscallDesc {
+	uint32_t sd_num;
+	uint32_t sd_args[5];
+	int32_t sd_ret;
+};
+
 #endif /* !JOS_INC_SYSCALL_H */
@@ -0,0 +1,22 @@
+#ifndef JOS_INC_TIME_H
+#define JOS_INC_TIME_H
+
+#include <inc/types.h>
+
+// The clock page, mapped read-only into every environment at UTIME so
+// that user code can tell the time with rdtsc instead of a system call.
+// The kernel fills it in once, at boot (see kern/time.c).
+struct TimePage {
+	uint64_t tp_tsc_boot;	// TSC at time 0
+	uint32_t tp_tsc_khz;	// TSC ticks per millisecond
+};
+
+// Convert 'tsc' TSC ticks to nanoseconds at 'khz' ticks per millisecond,
+// without overflowing however long the machine stays up.
+static __inline uint64_t
+tsc_to_nsec(uint64_t tsc, uint32_t khz)
+{
+	return tsc / khz * 1000000 + tsc % khz * 1000000 / khz;
+}
+
+#endif	// !JOS_INC_TIME_H
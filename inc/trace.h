@@ -0,0 +1,42 @@
+#ifndef JOS_INC_TRACE_H
+#define JOS_INC_TRACE_H
+
+#include <inc/types.h>
+#include <inc/syscall.h>
+#include <inc/env.h>
+
+// Counters the kernel keeps for each environment, on its UVDSO page
+// (struct Vdso).  Cycles are TSC cycles spent in the kernel; a call
+// inside sys_batch or from a ring counts on its own and as part of
+// whatever ran it.
+struct EnvStats {
+	uint32_t es_syscalls[NSYSCALLS];	// System calls, by number
+	uint64_t es_syscall_cycles[NSYSCALLS];
+	uint32_t es_pgfaults;		// Page faults
+	uint32_t es_cowfaults;		// ...that wrote to a read-only page
+	uint64_t es_pgfault_cycles;
+	uint32_t es_intrs;		// Device interrupts while we ran
+	uint64_t es_intr_cycles;
+};
+
+// System call tracing (see sys_env_trace).  The kernel appends a record
+// for each system call a traced environment makes to a ring on a page
+// that belongs to the tracer.  tr_head counts records forever; the
+// last TRACE_NENTRIES of them are in tr_ent, at tr_head modulo
+// TRACE_NENTRIES.  The newest record may still be in progress.
+#define TRACE_NENTRIES	64	// must be a power of 2
+
+struct TraceEntry {
+	envid_t te_envid;		// Who made the call
+	uint32_t te_num;		// System call number
+	uint32_t te_args[5];
+	int32_t te_ret;			// What it returned, if it has
+	uint32_t te_cycles;		// How long it took, if it returned
+};
+
+struct TraceRing {
+	volatile uint32_t tr_head;
+	struct TraceEntry tr_ent[TRACE_NENTRIES];
+};
+
+#endif	// !JOS_INC_TRACE_H
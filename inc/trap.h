@@ -27,6 +27,7 @@
 // These are arbitrarily chosen, but with care not to overlap
 // processor defined exceptions or interrupt vectors.
 #define T_SYSCALL   48		// system call
+#define T_SYSENTER  49		// system call through sysenter (no IDT entry)
 #define T_DEFAULT   500		// catchall
 
 #define IRQ_OFFSET	32	// IRQ 0 corresponds to int IRQ_OFFSET
@@ -39,6 +40,11 @@
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
 
+// For kern/trapentry.S: where tf_cs sits in a struct Trapframe,
+// and how big one is.
+#define TF_CS		0x34
+#define SIZEOF_TRAPFRAME 0x44
+
 #ifndef __ASSEMBLER__
 
 #include <inc/types.h>
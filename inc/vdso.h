@@ -0,0 +1,24 @@
+#ifndef JOS_INC_VDSO_H
+#define JOS_INC_VDSO_H
+
+#include <inc/env.h>
+#include <inc/trace.h>
+#include <inc/perf.h>
+
+// Each environment's own data page, mapped read-only at UVDSO, so that
+// the library can answer simple questions about it without a system
+// call.  Only the kernel writes it: when the environment is created,
+// and as it is switched in and preempted.  (The time base is the same
+// for everyone, so it lives on the clock page at UTIME instead.)
+struct Vdso {
+	envid_t vd_envid;		// Our env id
+	envid_t vd_parent_id;		// Our parent's env id
+	volatile int vd_cpunum;		// CPU we are running on
+	volatile uint32_t vd_runs;	// Times we have been switched in
+	volatile uint32_t vd_preempts;	// Times a clock tick took the CPU
+	struct EnvStats vd_stats;	// What we have had the kernel do
+	uint64_t vd_perf[PERF_NEVENTS];	// Perf counts, as of our last switch
+					// out (see sys_perf_read)
+};
+
+#endif	// !JOS_INC_VDSO_H
@@ -3,6 +3,19 @@
 
 #include <inc/types.h>
 
+// Model-specific registers
+#define MSR_SYSENTER_CS		0x174	// Kernel CS for sysenter
+#define MSR_SYSENTER_ESP	0x175	// Kernel ESP for sysenter
+#define MSR_SYSENTER_EIP	0x176	// Kernel entry point for sysenter
+#define MSR_PMC0		0x0c1	// First general-purpose perf counter
+#define MSR_PERFEVTSEL0		0x186	// ...and its event select register
+#define MSR_PERF_GLOBAL_CTRL	0x38f	// Perf counter enables (version 2+)
+
+// CPUID leaf 1 feature flags, in %edx
+#define CPUID_FEAT_SEP		0x00000800	// sysenter/sysexit
+#define CPUID_FEAT_FXSR		0x01000000	// fxsave/fxrstor
+#define CPUID_FEAT_SSE		0x02000000	// SSE
+
 static __inline void breakpoint(void) __attribute__((always_inline));
 static __inline uint8_t inb(int port) __attribute__((always_inline));
 static __inline void insb(int port, void *addr, int cnt) __attribute__((always_inline));
@@ -34,6 +47,8 @@ static __inline uint32_t read_ebp(void) __attribute__((always_inline));
 static __inline uint32_t read_esp(void) __attribute__((always_inline));
 static __inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
 static __inline uint64_t read_tsc(void) __attribute__((always_inline));
+static __inline uint64_t rdmsr(uint32_t msr) __attribute__((always_inline));
+static __inline void wrmsr(uint32_t msr, uint64_t val) __attribute__((always_inline));
 
 static __inline void
 breakpoint(void)
@@ -280,6 +295,20 @@ read_tsc(void)
 	return tsc;
 }
 
+static __inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	__asm __volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static __inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	__asm __volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
 static inline uint32_t
 xchg(volatile uint32_t *addr, uint32_t newval)
 {
@@ -293,4 +322,18 @@ xchg(volatile uint32_t *addr, uint32_t newval)
 	return result;
 }
 
+// Atomically: if *addr == expected, store newval.
+// Returns the value *addr held before the operation.
+static inline uint32_t
+cmpxchg(volatile uint32_t *addr, uint32_t expected, uint32_t newval)
+{
+	uint32_t result;
+
+	asm volatile("lock; cmpxchgl %2, %1" :
+			"=a" (result), "+m" (*addr) :
+			"r" (newval), "0" (expected) :
+			"cc");
+	return result;
+}
+
 #endif /* !JOS_INC_X86_H */
@@ -22,7 +22,10 @@ struct CpuInfo {
 	uint8_t cpu_id;                 // Local APIC ID; index into cpus[] below
 	volatile unsigned cpu_status;   // The status of the CPU
 	struct Env *cpu_env;            // The currently-running environment.
+	uint32_t cpu_sescratch[2];      // Below cpu_ts, for a #DB on sysenter
 	struct Taskstate cpu_ts;        // Used by x86 to find stack for interrupt
+	uintptr_t cpu_kstacktop;        // Top of this CPU's kernel stack
+	struct Env *cpu_fpu_env;        // Env whose state the FPU holds
 };
 
 // Initialized in mpconfig.c
@@ -6,6 +6,7 @@
 #include <inc/string.h>
 #include <inc/assert.h>
 #include <inc/elf.h>
+#include <inc/vdso.h>
 
 #include <kern/env.h>
 #include <kern/pmap.h>
@@ -14,6 +15,14 @@
 #include <kern/sched.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/futex.h>
+#include <kern/ipc.h>
+#include <kern/service.h>
+#include <kern/ring.h>
+#include <kern/fpu.h>
+#include <kern/trace.h>
+#include <kern/ktrace.h>
+#include <kern/perf.h>
 
 struct Env *envs = NULL;		// All environments
 static struct Env *env_free_list;	// Free environment list
@@ -164,7 +173,7 @@ static int
 env_setup_vm(struct Env *e)
 {
 	int i;
-	struct PageInfo *p = NULL;
+	struct PageInfo *p = NULL, *vp;
 
 	// Allocate a page for the page directory
 	if (!(p = page_alloc(ALLOC_ZERO)))
@@ -195,6 +204,20 @@ env_setup_vm(struct Env *e)
 	// Permissions: kernel R, user R
 	e->env_pgdir[PDX(UVPT)] = PADDR(e->env_pgdir) | PTE_P | PTE_U;
 
+	// UVDSO maps the env's own data page read-only.  We hold a
+	// reference of our own, since the kernel keeps writing the page
+	// through env_vdso even if the env unmaps it.
+	if (!(vp = page_alloc(ALLOC_ZERO))
+	    || page_insert(e->env_pgdir, vp, (void *) UVDSO, PTE_U) < 0) {
+		if (vp)
+			page_free(vp);
+		e->env_pgdir = NULL;
+		page_decref(p);
+		return -E_NO_MEM;
+	}
+	vp->pp_ref++;
+	e->env_vdso = page2kva(vp);
+
 	return 0;
 }
 
@@ -231,6 +254,8 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	e->env_type = ENV_TYPE_USER;
 	e->env_status = ENV_RUNNABLE;
 	e->env_runs = 0;
+	e->env_vdso->vd_envid = e->env_id;
+	e->env_vdso->vd_parent_id = parent_id;
 
 	// Clear out all the saved register state,
 	// to prevent the register values
@@ -259,14 +284,39 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	// Clear the page fault handler until user installs one.
 	e->env_pgfault_upcall = 0;
 
-	// Also clear the IPC receiving flag.
+	// Also clear the IPC receiving flag, and the send queues.
 	e->env_ipc_recving = 0;
+	e->env_ipc_waitfrom = 0;
+	e->env_ipc_sendq = NULL;
+	e->env_ipc_sendlink = NULL;
+	e->env_ipc_sendto = 0;
+	e->env_ipc_deadline = 0;
+	e->env_ipc_notify = 0;
+
+	// Not waiting on any futex.
+	memset(e->env_futex, 0, sizeof(e->env_futex));
+	e->env_futex_deadline = 0;
+
+	// Nobody else may map pages into us until we ask for them.
+	e->env_accept_va = 0;
+	e->env_accept_len = 0;
+	e->env_accept_key = 0;
+
+	// No asynchronous system calls until we ask for them.
+	e->env_ring = NULL;
+	e->env_ring_va = NULL;
+	e->env_trace = NULL;
+
+	// No FPU state until the first FPU instruction (see kern/fpu.c).
+	e->env_fpu = NULL;
+	e->env_fpu_cpu = -1;
 
 	// commit the allocation
 	env_free_list = e->env_link;
 	*newenv_store = e;
 
 	// cprintf("[%08x] new env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
+	KTRACE(KT_ENV_CREATE, e->env_id, parent_id, 0);
 	return 0;
 }
 
@@ -444,6 +494,16 @@ env_free(struct Env *e)
 
 	// Note the environment's demise.
 	// cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
+	KTRACE(KT_ENV_DESTROY, e->env_id, 0, 0);
+
+	// A freed environment can't be woken, send or receive IPC, serve
+	// anything, or hold on to its ring, trace, and FPU pages.
+	futex_remove(e);
+	ipc_remove(e);
+	service_remove(e);
+	ring_remove(e);
+	trace_remove(e);
+	fpu_free(e);
 
 	// Flush all mapped pages in the user portion of the address space
 	static_assert(UTOP % PTSIZE == 0);
@@ -468,15 +528,21 @@ env_free(struct Env *e)
 		page_decref(pa2page(pa));
 	}
 
-	// free the page directory
+	// free the page directory, and drop our hold on the UVDSO page
 	pa = PADDR(e->env_pgdir);
 	e->env_pgdir = 0;
 	page_decref(pa2page(pa));
+	page_decref(pa2page(PADDR(e->env_vdso)));
+	e->env_vdso = NULL;
 
 	// return the environment to the free list
 	e->env_status = ENV_FREE;
 	e->env_link = env_free_list;
 	env_free_list = e;
+
+	// Wake anyone in wait() blocked on this env's status word,
+	// which user space sees through the read-only envs[] at UENVS.
+	futex_wake_key(PADDR(&e->env_status), NENV);
 }
 
 //
@@ -513,8 +579,42 @@ env_destroy(struct Env *e)
 void
 env_pop_tf(struct Trapframe *tf)
 {
+	static_assert(offsetof(struct Trapframe, tf_cs) == TF_CS);
+	static_assert(sizeof(struct Trapframe) == SIZEOF_TRAPFRAME);
+	static_assert(offsetof(struct Env, env_kstack)
+		      == offsetof(struct Env, env_tf) + sizeof(struct Trapframe));
+
 	// Record the CPU we are running on for user-space debugging
 	curenv->env_cpunum = cpunum();
+	curenv->env_vdso->vd_cpunum = curenv->env_cpunum;
+
+	// Have the next trap save its frame directly into env_tf, then
+	// move to this CPU's kernel stack (see _alltraps).
+	thiscpu->cpu_ts.ts_esp0 = (uintptr_t) (&curenv->env_tf + 1);
+	curenv->env_kstack = thiscpu->cpu_kstacktop;
+
+	// Return from a sysenter with sysexit, which takes the user %eip
+	// and %esp in %edx and %ecx and leaves %eflags alone.  That means
+	// loading the user's flags while still in the kernel, so only do it
+	// when they hold nothing that matters there (TF would trap in the
+	// kernel, NT would turn a later iret into a task switch); otherwise
+	// iret.  Load them with interrupts still off; sti holds them off for
+	// one more instruction, so none arrive on this stack after the switch.
+	if (tf->tf_trapno == T_SYSENTER
+	    && !(tf->tf_eflags & (FL_TF|FL_NT|FL_AC)))
+		__asm __volatile("movl %0,%%esp\n"
+			"\tpopal\n"
+			"\tpopl %%es\n"
+			"\tpopl %%ds\n"
+			"\taddl $0x8,%%esp\n" /* skip tf_trapno and tf_errcode */
+			"\tmovl 0(%%esp),%%edx\n"	/* tf_eip */
+			"\tmovl 12(%%esp),%%ecx\n"	/* tf_esp */
+			"\tpushl 8(%%esp)\n"	/* tf_eflags */
+			"\tandl $~%c1,(%%esp)\n"
+			"\tpopfl\n"
+			"\tsti\n"
+			"\tsysexit"
+			: : "g" (tf), "i" (FL_IF) : "memory");
 
 	__asm __volatile("movl %0,%%esp\n"
 		"\tpopal\n"
@@ -555,9 +655,14 @@ env_run(struct Env *e)
 	if (curenv != NULL && curenv->env_status == ENV_RUNNING) {
 		curenv->env_status = ENV_RUNNABLE;
 	}
+	if (curenv != e)
+		KTRACE(KT_SWITCH, e->env_id, 0, 0);
+	fpu_switch(curenv, e);
+	perf_switch(curenv, e);
 	curenv = e;
 	curenv->env_status = ENV_RUNNING;
 	curenv->env_runs++;
+	curenv->env_vdso->vd_runs = curenv->env_runs;
 	lcr3(PADDR(curenv->env_pgdir));
 	unlock_kernel();
 	env_pop_tf(&curenv->env_tf);
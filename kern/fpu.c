@@ -0,0 +1,173 @@
+// Lazy x87/MMX/SSE state switching.
+//
+// An environment's FPU registers are saved in a page of its own
+// (Env->env_fpu), allocated the first time it uses the FPU, so
+// environments that never do cost nothing.  Each CPU remembers whose
+// state its registers hold (CpuInfo->cpu_fpu_env).  env_run sets CR0.TS
+// unless the incoming environment's state is already loaded, so that
+// its first FPU instruction traps with #NM and fpu_trap loads the state
+// then.  The kernel itself never uses the FPU.
+//
+// Saving is eager: an environment that used the FPU during its time
+// slice (and so ran with TS clear) is saved as we switch away from it.
+// That keeps env_fpu current whenever the environment isn't running,
+// so it can move to another CPU without this one having to give up its
+// registers first.  Env->env_fpu_cpu says which CPU's registers still
+// match env_fpu, if any.
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/cpu.h>
+#include <kern/fpu.h>
+
+#define FXSAVE_SIZE	512
+#define MXCSR_DEFAULT	0x1f80	// All SIMD exceptions masked
+
+// Whether the CPUs have FXSAVE and SSE.  Without them, user FPU
+// instructions trap with #NM for good, and fpu_trap refuses them.
+static bool fpu_ok;
+
+// What a new environment's FPU starts out as: the state after fninit,
+// with SIMD exceptions masked and every data register zero.  The first
+// CPU to start up fills it in.
+static uint8_t fpu_initstate[FXSAVE_SIZE] __attribute__((aligned(16)));
+static bool fpu_initstate_ready;
+
+static __inline void
+clts(void)
+{
+	__asm __volatile("clts");
+}
+
+static __inline void
+fxsave(void *area)
+{
+	__asm __volatile("fxsave (%0)" : : "r" (area) : "memory");
+}
+
+static __inline void
+fxrstor(const void *area)
+{
+	__asm __volatile("fxrstor (%0)" : : "r" (area) : "memory");
+}
+
+// Whether curenv may use the FPU registers without trapping.
+static __inline bool
+fpu_live(void)
+{
+	return !(rcr0() & CR0_TS);
+}
+
+// Enable FXSAVE and SSE on this CPU, and have the FPU trap until some
+// environment needs it.
+void
+fpu_init_percpu(void)
+{
+	uint32_t edx, mxcsr = MXCSR_DEFAULT;
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	fpu_ok = (edx & (CPUID_FEAT_FXSR|CPUID_FEAT_SSE))
+		== (CPUID_FEAT_FXSR|CPUID_FEAT_SSE);
+	thiscpu->cpu_fpu_env = NULL;
+	if (!fpu_ok) {
+		lcr0(rcr0() | CR0_EM);
+		return;
+	}
+
+	lcr4(rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+	lcr0((rcr0() & ~CR0_EM) | CR0_MP | CR0_NE);
+
+	// Build the state new environments start from once, the first time
+	// through.  bootcpu isn't known yet, but that is the boot CPU.
+	if (!fpu_initstate_ready) {
+		__asm __volatile("fninit; ldmxcsr %0" : : "m" (mxcsr));
+		fxsave(fpu_initstate);
+		// Bytes 32 to 415 hold the x87 and XMM data registers.
+		memset(fpu_initstate + 32, 0, 416 - 32);
+		fpu_initstate_ready = true;
+	}
+	lcr0(rcr0() | CR0_TS);
+}
+
+// Handle a device-not-available trap (#NM) by giving curenv the FPU,
+// with the state it last left there, or a fresh state the first time.
+// Returns 0 on success, < 0 if the trap is not ours to fix.  Errors are:
+//	-E_INVAL if the kernel tripped it, or the CPU lacks FXSAVE or SSE.
+//	-E_NO_MEM if there was no page to save curenv's state in.
+int
+fpu_trap(struct Trapframe *tf)
+{
+	struct PageInfo *pp;
+
+	if ((tf->tf_cs & 3) != 3 || !fpu_ok)
+		return -E_INVAL;
+	if (!curenv->env_fpu) {
+		if (!(pp = page_alloc(0)))
+			return -E_NO_MEM;
+		pp->pp_ref++;
+		curenv->env_fpu = page2kva(pp);
+		memmove(curenv->env_fpu, fpu_initstate, FXSAVE_SIZE);
+	}
+	// Whoever had the registers before was saved when it left.
+	clts();
+	fxrstor(curenv->env_fpu);
+	thiscpu->cpu_fpu_env = curenv;
+	curenv->env_fpu_cpu = cpunum();
+	return 0;
+}
+
+// This CPU is switching from 'prev' (which may be NULL, or 'next' itself)
+// to 'next' (which is NULL if the CPU is about to halt).  Save prev's FPU
+// state if it used the FPU, and let next use the registers straight away
+// if they're already its own.
+void
+fpu_switch(struct Env *prev, struct Env *next)
+{
+	if (!fpu_ok)
+		return;
+	if (prev && prev != next && thiscpu->cpu_fpu_env == prev
+	    && fpu_live())
+		fxsave(prev->env_fpu);
+	if (next && thiscpu->cpu_fpu_env == next
+	    && next->env_fpu_cpu == cpunum())
+		clts();
+	else
+		lcr0(rcr0() | CR0_TS);
+}
+
+// Give 'child' a copy of curenv 'parent''s FPU state, if it has any.
+// Returns 0 on success, -E_NO_MEM if out of memory.
+int
+fpu_fork(struct Env *parent, struct Env *child)
+{
+	struct PageInfo *pp;
+
+	if (!parent->env_fpu)
+		return 0;
+	if (!(pp = page_alloc(0)))
+		return -E_NO_MEM;
+	pp->pp_ref++;
+	child->env_fpu = page2kva(pp);
+	// The parent's latest state may still be only in our registers.
+	if (thiscpu->cpu_fpu_env == parent && fpu_live())
+		fxsave(parent->env_fpu);
+	memmove(child->env_fpu, parent->env_fpu, FXSAVE_SIZE);
+	return 0;
+}
+
+// Free e's saved FPU state.
+void
+fpu_free(struct Env *e)
+{
+	if (e->env_fpu) {
+		page_decref(pa2page(PADDR(e->env_fpu)));
+		e->env_fpu = NULL;
+	}
+	e->env_fpu_cpu = -1;
+}
@@ -0,0 +1,239 @@
+// Kernel wait queues for user-level synchronization ("futexes").
+//
+// An environment can block on a 32-bit word in its address space until
+// another environment wakes it.  Waiters are keyed by the physical address
+// of the word, so environments sharing a page (a PTE_SHARE page, or the
+// read-only envs[] mapping at UENVS) meet on the same queue no matter
+// where each of them has the page mapped.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/futex.h>
+#include <kern/time.h>
+
+#define FUTEX_HASHSIZE	64
+// Hash on the page alone, so futex_wake_page only has to scan one bucket.
+#define FUTEX_HASH(key)	(PGNUM(key) % FUTEX_HASHSIZE)
+
+// Each bucket is a FIFO list of wait queue nodes, linked by fn_link.
+// An environment waiting on several words has a node in each of their
+// buckets (Env->env_futex[]).
+static struct FutexNode *futex_queues[FUTEX_HASHSIZE];
+
+// Number of environments with a deadline set, so that futex_expire
+// can skip scanning envs[] on almost every tick.
+static int futex_ntimed;
+
+// Translate user virtual address 'uaddr' in e's address space into the
+// physical address that identifies its wait queue.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if uaddr is not 4-byte aligned or is above ULIM.
+//	-E_FAULT if uaddr is not mapped readable by the user.
+static int
+futex_key(struct Env *e, const volatile void *uaddr, physaddr_t *key_store)
+{
+	pte_t *pte;
+
+	if ((uintptr_t) uaddr >= ULIM || ((uintptr_t) uaddr & 3) != 0)
+		return -E_INVAL;
+	if (!page_lookup(e->env_pgdir, (void *) uaddr, &pte)
+	    || !(*pte & PTE_U))
+		return -E_FAULT;
+	*key_store = PTE_ADDR(*pte) | PGOFF(uaddr);
+	return 0;
+}
+
+// Block 'e' until one of the 'n' words described by 'w' is woken,
+// provided each still holds the value the caller expects.
+// 'w' must already be in kernel memory.  Comparing and enqueueing happen
+// under the kernel lock, so a wakeup issued after the caller changed a
+// word can never be lost.
+// The caller must give up the CPU; once woken, the system call returns
+// the index in 'w' of the word that was woken.
+//
+// If an entry's fw_refs is nonzero, 'e' also refuses to sleep unless the
+// page holding that word is still mapped exactly fw_refs times.  Together
+// with the wakeup in futex_wake_page, this lets sharers that detect a
+// departed peer via pageref() (like pipes) block without missing the
+// departure.
+//
+// If 'timeout' is positive, 'e' wakes up after that many milliseconds
+// regardless, and the system call returns -E_TIMEOUT; a negative
+// 'timeout' waits forever.
+//
+// Returns 0 if 'e' is now blocked, < 0 on error.  Errors are:
+//	-E_AGAIN if a word no longer holds its expected value,
+//		or a page's reference count no longer matches.
+//	-E_TIMEOUT if 'timeout' is 0 and 'e' would have blocked.
+//	-E_INVAL if n < 0 or n > FUTEX_NWAIT.
+//	-E_INVAL, -E_FAULT if an address is bad (see futex_key).
+int
+futex_waitv(struct Env *e, const struct FutexWait *w, int n, int timeout)
+{
+	physaddr_t keys[FUTEX_NWAIT];
+	struct FutexNode **pp, *fn;
+	int i, r;
+
+	if (n < 0 || n > FUTEX_NWAIT)
+		return -E_INVAL;
+	for (i = 0; i < n; i++) {
+		if ((r = futex_key(e, w[i].fw_addr, &keys[i])) < 0)
+			return r;
+		if (*(volatile uint32_t *) KADDR(keys[i]) != w[i].fw_expected)
+			return -E_AGAIN;
+		if (w[i].fw_refs && pa2page(keys[i])->pp_ref != w[i].fw_refs)
+			return -E_AGAIN;
+	}
+	if (timeout == 0)
+		return -E_TIMEOUT;
+
+	futex_remove(e);
+	for (i = 0; i < n; i++) {
+		fn = &e->env_futex[i];
+		for (pp = &futex_queues[FUTEX_HASH(keys[i])]; *pp; pp = &(*pp)->fn_link)
+			/* find the tail */;
+		*pp = fn;
+		fn->fn_link = NULL;
+		fn->fn_key = keys[i];
+		fn->fn_env = e;
+	}
+	if (timeout > 0) {
+		// Deadline 0 means "none", so nudge a deadline that lands on it.
+		e->env_futex_deadline = time_msec() + timeout;
+		if (!e->env_futex_deadline)
+			e->env_futex_deadline = 1;
+		futex_ntimed++;
+	}
+	e->env_status = ENV_NOT_RUNNABLE;
+	return 0;
+}
+
+// Block 'e' on the single word at 'uaddr', with no timeout.
+// See futex_waitv.
+int
+futex_wait(struct Env *e, const void *uaddr, uint32_t expected, int refs)
+{
+	struct FutexWait w;
+
+	w.fw_addr = uaddr;
+	w.fw_expected = expected;
+	w.fw_refs = refs;
+	return futex_waitv(e, &w, 1, -1);
+}
+
+// Take 'e' off all its wait queues and make its system call return 'ret'.
+static void
+futex_wakeup(struct Env *e, int32_t ret)
+{
+	futex_remove(e);
+	// Someone else may have made 'e' runnable behind our back
+	// (sys_env_set_status); then it's no longer ours to wake.
+	if (e->env_status != ENV_NOT_RUNNABLE)
+		return;
+	e->env_tf.tf_regs.reg_eax = ret;
+	e->env_status = ENV_RUNNABLE;
+}
+
+// Find the oldest node waiting on any word in the physical page at 'pa'
+// ('page' set), or on exactly the word at 'pa'.
+static struct FutexNode *
+futex_find(physaddr_t pa, bool page)
+{
+	struct FutexNode *fn;
+
+	for (fn = futex_queues[FUTEX_HASH(pa)]; fn; fn = fn->fn_link)
+		if (page ? PGNUM(fn->fn_key) == PGNUM(pa) : fn->fn_key == pa)
+			return fn;
+	return NULL;
+}
+
+// Wake at most 'n' environments waiting on physical address 'key',
+// oldest first.  Returns the number of environments woken.
+int
+futex_wake_key(physaddr_t key, int n)
+{
+	struct FutexNode *fn;
+	int woken = 0;
+
+	while (woken < n && (fn = futex_find(key, 0))) {
+		futex_wakeup(fn->fn_env, fn - fn->fn_env->env_futex);
+		woken++;
+	}
+	return woken;
+}
+
+// Wake every environment waiting on any word in the physical page at 'pa'.
+// page_remove calls this whenever a mapping goes away, so that waiters
+// learn about peers that unmapped a shared page -- including peers that
+// died without running any user-level cleanup.
+void
+futex_wake_page(physaddr_t pa)
+{
+	struct FutexNode *fn;
+
+	while ((fn = futex_find(pa, 1)))
+		futex_wakeup(fn->fn_env, fn - fn->fn_env->env_futex);
+}
+
+// Wake at most 'n' environments waiting on the word at 'uaddr' in e's
+// address space.  Returns the number woken, or < 0 if 'uaddr' is bad.
+int
+futex_wake(struct Env *e, const void *uaddr, int n)
+{
+	physaddr_t key;
+	int r;
+
+	if ((r = futex_key(e, uaddr, &key)) < 0)
+		return r;
+	return futex_wake_key(key, n);
+}
+
+// Wake every environment whose futex_waitv deadline has passed.
+// Called on every clock tick.
+void
+futex_expire(void)
+{
+	unsigned now;
+	int i;
+
+	if (!futex_ntimed)
+		return;
+	now = time_msec();
+	for (i = 0; i < NENV; i++)
+		if (envs[i].env_futex_deadline
+		    && (int) (now - envs[i].env_futex_deadline) >= 0)
+			futex_wakeup(&envs[i], -E_TIMEOUT);
+}
+
+// Take 'e' off whatever wait queues it is on and cancel its deadline,
+// without waking it.  Called when an environment is freed.
+void
+futex_remove(struct Env *e)
+{
+	struct FutexNode **pp, *fn;
+	int i;
+
+	for (i = 0; i < FUTEX_NWAIT; i++) {
+		fn = &e->env_futex[i];
+		// Physical page 0 is never handed out,
+		// so key 0 means "not waiting".
+		if (!fn->fn_key)
+			continue;
+		for (pp = &futex_queues[FUTEX_HASH(fn->fn_key)]; *pp;
+		     pp = &(*pp)->fn_link)
+			if (*pp == fn) {
+				*pp = fn->fn_link;
+				break;
+			}
+		fn->fn_link = NULL;
+		fn->fn_key = 0;
+	}
+	if (e->env_futex_deadline) {
+		e->env_futex_deadline = 0;
+		futex_ntimed--;
+	}
+}
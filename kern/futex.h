@@ -0,0 +1,22 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_FUTEX_H
+#define JOS_KERN_FUTEX_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+struct Env;
+struct FutexWait;
+
+int	futex_wait(struct Env *e, const void *uaddr, uint32_t expected, int refs);
+int	futex_waitv(struct Env *e, const struct FutexWait *w, int n, int timeout);
+int	futex_wake(struct Env *e, const void *uaddr, int n);
+int	futex_wake_key(physaddr_t key, int n);
+void	futex_wake_page(physaddr_t pa);
+void	futex_expire(void);
+void	futex_remove(struct Env *e);
+
+#endif	// !JOS_KERN_FUTEX_H
@@ -14,6 +14,8 @@
 #include <kern/picirq.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/time.h>
+#include <kern/kdebug.h>
 
 static void boot_aps(void);
 
@@ -34,6 +36,9 @@ i386_init(void)
 
 	cprintf("6828 decimal is %o octal!\n", 6828);
 
+	// Index the kernel's functions for backtraces and profiling.
+	kdebug_init();
+
 	// Lab 2 memory management initialization functions
 	mem_init();
 
@@ -47,6 +52,7 @@ i386_init(void)
 
 	// Lab 4 multitasking initialization functions
 	pic_init();
+	time_init();
 
 	// Acquire the big kernel lock before waking up APs
 	lock_kernel();
@@ -0,0 +1,408 @@
+// Kernel side of IPC: handing a value (and maybe a page) from one
+// environment to another, and queueing senders whose receiver isn't
+// ready yet.
+//
+// Each environment has a FIFO queue of senders blocked on it
+// (Env->env_ipc_sendq, linked by env_ipc_sendlink).  A blocked sender
+// keeps its message in its own Env until the receiver calls
+// sys_ipc_recv, which takes the oldest sender's message and wakes it
+// without ever blocking itself.
+//
+// A call (sys_ipc_call) is a send followed by a receive that only
+// accepts the callee's reply (Env->env_ipc_waitfrom).  When a call or
+// reply can be delivered on the spot, we switch straight to the
+// environment that just got the message instead of going through
+// sched_yield.
+//
+// A receive (or a call, for its whole duration) may carry a timeout;
+// ipc_expire gives up on it once Env->env_ipc_deadline passes.
+//
+// Notifications (sys_ipc_notify) are bits ORed into the receiver's
+// env_ipc_notify, so sending one never blocks.  Pending bits are
+// delivered, from envid 0, ahead of any queued message the next time the
+// receiver is in an open receive.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+#include <inc/string.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/ipc.h>
+#include <kern/sched.h>
+#include <kern/time.h>
+
+// Number of environments with a deadline set, so that ipc_expire
+// usually has nothing to scan.
+static int ipc_ntimed;
+
+// Give 'e' up to 'timeout' ms (forever if negative) to finish its
+// receive or call.
+static void
+ipc_set_deadline(struct Env *e, int timeout)
+{
+	if (timeout < 0)
+		return;
+	// Deadline 0 means "none", so nudge a deadline that lands on it.
+	e->env_ipc_deadline = time_msec() + timeout;
+	if (!e->env_ipc_deadline)
+		e->env_ipc_deadline = 1;
+	ipc_ntimed++;
+}
+
+static void
+ipc_clear_deadline(struct Env *e)
+{
+	if (e->env_ipc_deadline) {
+		e->env_ipc_deadline = 0;
+		ipc_ntimed--;
+	}
+}
+
+// Hand 'value', the payload words src staged in env_ipc_sendmsg, and the
+// env_ipc_sendpages pages at 'srcva' in src's address space (if both
+// sides want pages) to 'dst', which must be blocked receiving.
+// Only as many pages as fit dst's receive window are mapped.
+// Clears dst's env_ipc_recving; making 'dst' runnable is up to the caller.
+//
+// Returns the number of pages transferred, < 0 on error
+// (in which case 'dst' is still receiving).  Errors are:
+//	-E_INVAL if srcva < UTOP but srcva is not page-aligned, the pages
+//		run past UTOP or are not all mapped in src's address space,
+//		or perm is inappropriate.
+//	-E_INVAL if (perm & PTE_W), but one of the pages is read-only in src.
+//	-E_NO_MEM if there's not enough memory to map the pages in dst.
+int
+ipc_deliver(struct Env *src, struct Env *dst, uint32_t value,
+	    void *srcva, int perm)
+{
+	struct PageInfo *pp[IPC_MAXPAGES];
+	pte_t *pte;
+	int i, n = 0;
+
+	assert(dst->env_ipc_recving);
+	if ((uintptr_t) srcva < UTOP && (uintptr_t) dst->env_ipc_dstva < UTOP) {
+		n = MIN(src->env_ipc_sendpages, dst->env_ipc_dstpages);
+		if (PGOFF(srcva) != 0
+		    || (uintptr_t) srcva + n * PGSIZE > UTOP
+		    || (perm & (PTE_U|PTE_P)) != (PTE_U|PTE_P)
+		    || (perm & ~PTE_SYSCALL) != 0)
+			return -E_INVAL;
+		// Check every page, and make sure dst has the page tables to
+		// map them, before changing anything: a message goes through
+		// whole or not at all.
+		for (i = 0; i < n; i++) {
+			if (!(pp[i] = page_lookup(src->env_pgdir, srcva + i * PGSIZE, &pte))
+			    || ((perm & PTE_W) && !(*pte & PTE_W)))
+				return -E_INVAL;
+			if (!pgdir_walk(dst->env_pgdir,
+					dst->env_ipc_dstva + i * PGSIZE, 1))
+				return -E_NO_MEM;
+		}
+		for (i = 0; i < n; i++)
+			if (page_insert(dst->env_pgdir, pp[i],
+					dst->env_ipc_dstva + i * PGSIZE, perm) < 0)
+				panic("ipc_deliver: page_insert failed");
+	}
+
+	ipc_clear_deadline(dst);
+	dst->env_ipc_recving = 0;
+	dst->env_ipc_waitfrom = 0;
+	dst->env_ipc_from = src->env_id;
+	dst->env_ipc_fromcall = src->env_ipc_waitfrom == dst->env_id;
+	dst->env_ipc_value = value;
+	dst->env_ipc_perm = n ? perm : 0;
+	dst->env_ipc_npages = n;
+	dst->env_ipc_msglen = src->env_ipc_sendlen;
+	memmove(dst->env_ipc_msg, src->env_ipc_sendmsg,
+		src->env_ipc_sendlen * sizeof(uint32_t));
+	return n;
+}
+
+// Hand 'e', which must be in an open receive, its pending notification
+// bits as a message from envid 0.
+static void
+ipc_deliver_notify(struct Env *e)
+{
+	ipc_clear_deadline(e);
+	e->env_ipc_recving = 0;
+	e->env_ipc_from = 0;
+	e->env_ipc_fromcall = 0;
+	e->env_ipc_value = e->env_ipc_notify;
+	e->env_ipc_perm = 0;
+	e->env_ipc_npages = 0;
+	e->env_ipc_msglen = 0;
+	e->env_ipc_notify = 0;
+}
+
+// Is 'dst' ready to take a message from 'src' right now?
+// A caller waiting for its reply only takes it from the callee;
+// otherwise, queued senders go first.
+static bool
+ipc_ready(struct Env *src, struct Env *dst)
+{
+	if (!dst->env_ipc_recving)
+		return 0;
+	if (dst->env_ipc_waitfrom)
+		return dst->env_ipc_waitfrom == src->env_id;
+	return !dst->env_ipc_sendq;
+}
+
+// Wake 'e' from a blocked send or receive, making its system call
+// return 'ret'.
+static void
+ipc_wake(struct Env *e, int ret)
+{
+	ipc_clear_deadline(e);
+	e->env_tf.tf_regs.reg_eax = ret;
+	if (e->env_status == ENV_NOT_RUNNABLE)
+		e->env_status = ENV_RUNNABLE;
+}
+
+// Finish the blocked send of 'src', whose delivery returned 'ret'.
+// If it was the first half of a call, 'src' goes on waiting for the reply.
+static void
+ipc_send_done(struct Env *src, int ret)
+{
+	src->env_ipc_sendto = 0;
+	src->env_ipc_sendlink = NULL;
+	if (ret >= 0 && src->env_ipc_waitfrom) {
+		src->env_ipc_recving = 1;
+		return;
+	}
+	src->env_ipc_waitfrom = 0;
+	ipc_wake(src, ret);
+}
+
+// Deliver a message from 'src' to 'dst' if 'dst' is ready for it,
+// without blocking.  Makes 'dst' runnable on success.
+//
+// Returns what ipc_deliver returns, or -E_IPC_NOT_RECV if 'dst' isn't
+// receiving (or is only waiting for a reply from someone else).
+int
+ipc_try_send(struct Env *src, struct Env *dst, uint32_t value,
+	     void *srcva, int perm)
+{
+	int r;
+
+	if (!ipc_ready(src, dst))
+		return -E_IPC_NOT_RECV;
+	if ((r = ipc_deliver(src, dst, value, srcva, perm)) >= 0)
+		dst->env_status = ENV_RUNNABLE;
+	return r;
+}
+
+// Send a message from 'src' to 'dst', delivering it at once if 'dst' is
+// receiving (and nobody is queued ahead of us), and otherwise putting
+// 'src' to sleep at the end of dst's send queue.
+// A sleeping sender's system call eventually returns what ipc_deliver
+// returned for it, or -E_BAD_ENV if 'dst' went away first.
+//
+// Returns >= 0 if the message was delivered or 'src' is now blocked,
+// < 0 on error (see ipc_deliver).
+int
+ipc_send(struct Env *src, struct Env *dst, uint32_t value,
+	 void *srcva, int perm)
+{
+	struct Env **pp;
+
+	if (ipc_ready(src, dst))
+		return ipc_try_send(src, dst, value, srcva, perm);
+
+	for (pp = &dst->env_ipc_sendq; *pp; pp = &(*pp)->env_ipc_sendlink)
+		/* find the tail */;
+	*pp = src;
+	src->env_ipc_sendlink = NULL;
+	src->env_ipc_sendto = dst->env_id;
+	src->env_ipc_sendval = value;
+	src->env_ipc_sendva = srcva;
+	src->env_ipc_sendperm = perm;
+	src->env_status = ENV_NOT_RUNNABLE;
+	return 0;
+}
+
+// Start receiving up to 'npages' pages into 'dstva' (see sys_ipc_recv),
+// for at most 'timeout' ms (forever if negative).
+// If notifications are pending or senders are queued on 'e', take the
+// notifications or the oldest message that can be delivered and return
+// without blocking; otherwise mark 'e' not runnable.
+// Returns 0, or -E_TIMEOUT if there was nothing to take and 'timeout'
+// is 0.
+int
+ipc_recv(struct Env *e, void *dstva, int npages, int timeout)
+{
+	struct Env *src;
+	int r;
+
+	e->env_ipc_dstva = dstva;
+	e->env_ipc_dstpages = npages;
+	e->env_ipc_recving = 1;
+	e->env_ipc_waitfrom = 0;
+	if (e->env_ipc_notify) {
+		ipc_deliver_notify(e);
+		return 0;
+	}
+	while ((src = e->env_ipc_sendq) != NULL) {
+		e->env_ipc_sendq = src->env_ipc_sendlink;
+		r = ipc_deliver(src, e, src->env_ipc_sendval,
+				src->env_ipc_sendva, src->env_ipc_sendperm);
+		ipc_send_done(src, r);
+		if (r >= 0)
+			return 0;
+	}
+	if (timeout == 0) {
+		e->env_ipc_recving = 0;
+		return -E_TIMEOUT;
+	}
+	ipc_set_deadline(e, timeout);
+	e->env_status = ENV_NOT_RUNNABLE;
+	return 0;
+}
+
+// OR 'bits' into the notifications pending for 'dst', delivering them
+// at once if 'dst' is blocked in an open receive.  Never blocks.
+void
+ipc_notify(struct Env *dst, uint32_t bits)
+{
+	dst->env_ipc_notify |= bits;
+	if (dst->env_ipc_recving && !dst->env_ipc_waitfrom) {
+		ipc_deliver_notify(dst);
+		ipc_wake(dst, 0);
+	}
+}
+
+// Send a message from 'src' to 'dst' like ipc_send, then wait for dst's
+// reply, whose pages get mapped at 'dstva' as for ipc_recv.  Messages from
+// anyone else wait in src's send queue meanwhile.  Once the reply
+// arrives, the system call returns 0; if 'timeout' ms (> 0) pass first,
+// it returns -E_TIMEOUT instead.
+// If the request could be delivered at once, this runs 'dst' right
+// away and does not return.
+//
+// Returns 0 if 'src' is now blocked, < 0 on error (see ipc_deliver).
+int
+ipc_call(struct Env *src, struct Env *dst, uint32_t value,
+	 void *srcva, int perm, void *dstva, int npages, int timeout)
+{
+	int r;
+
+	src->env_ipc_dstva = dstva;
+	src->env_ipc_dstpages = npages;
+	src->env_ipc_waitfrom = dst->env_id;
+	if (!ipc_ready(src, dst)) {
+		// Queue up; ipc_send_done starts the receive.
+		ipc_set_deadline(src, timeout);
+		return ipc_send(src, dst, value, srcva, perm);
+	}
+
+	if ((r = ipc_try_send(src, dst, value, srcva, perm)) < 0) {
+		src->env_ipc_waitfrom = 0;
+		return r;
+	}
+	ipc_set_deadline(src, timeout);
+	src->env_ipc_recving = 1;
+	src->env_status = ENV_NOT_RUNNABLE;
+	src->env_tf.tf_regs.reg_eax = 0;
+	env_run(dst);
+}
+
+// Server side of ipc_call: reply to 'to' (unless it is 0), then receive
+// the next request at 'dstva' as ipc_recv does, with the same 'timeout'.
+// The reply only goes through if 'to' is waiting for one from 'e';
+// otherwise it is dropped, since a server shouldn't get stuck on a client
+// that went away.  (A request that didn't come from ipc_call has
+// env_ipc_fromcall clear; its sender may not be receiving yet, so the
+// server should answer it with an ordinary send instead.)
+// If there is no request waiting for us, this runs the client we just
+// replied to right away and does not return.
+// Returns what ipc_recv returns.
+int
+ipc_reply_wait(struct Env *e, envid_t to, uint32_t value,
+	       void *srcva, int perm, void *dstva, int npages, int timeout)
+{
+	struct Env *client = NULL;
+	int r;
+
+	if (to && envid2env(to, &client, 0) == 0
+	    && ipc_try_send(e, client, value, srcva, perm) < 0)
+		client = NULL;
+
+	r = ipc_recv(e, dstva, npages, timeout);
+	if (e->env_status == ENV_NOT_RUNNABLE && client) {
+		e->env_tf.tf_regs.reg_eax = 0;
+		env_run(client);
+	}
+	return r;
+}
+
+// Take 'e', blocked sending, out of its receiver's send queue.
+static void
+ipc_dequeue(struct Env *e)
+{
+	struct Env *dst, **pp;
+
+	dst = &envs[ENVX(e->env_ipc_sendto)];
+	if (dst->env_id == e->env_ipc_sendto)
+		for (pp = &dst->env_ipc_sendq; *pp; pp = &(*pp)->env_ipc_sendlink)
+			if (*pp == e) {
+				*pp = e->env_ipc_sendlink;
+				break;
+			}
+	e->env_ipc_sendto = 0;
+	e->env_ipc_sendlink = NULL;
+}
+
+// Fail every receive and call whose deadline has passed with -E_TIMEOUT.
+// A call still queued behind other senders leaves the queue, so its
+// request is never delivered.  Called on every clock tick.
+void
+ipc_expire(void)
+{
+	struct Env *e;
+	unsigned now;
+	int i;
+
+	if (!ipc_ntimed)
+		return;
+	now = time_msec();
+	for (i = 0; i < NENV; i++) {
+		e = &envs[i];
+		if (!e->env_ipc_deadline
+		    || (int) (now - e->env_ipc_deadline) < 0)
+			continue;
+		if (e->env_ipc_sendto)
+			ipc_dequeue(e);
+		e->env_ipc_recving = 0;
+		e->env_ipc_waitfrom = 0;
+		ipc_wake(e, -E_TIMEOUT);
+	}
+}
+
+// Untangle 'e' from the send queues before it is freed: senders (and
+// callers) waiting on 'e' fail with -E_BAD_ENV, and if 'e' is itself
+// queued as a sender, it leaves its receiver's queue.
+void
+ipc_remove(struct Env *e)
+{
+	int i;
+
+	while (e->env_ipc_sendq) {
+		struct Env *src = e->env_ipc_sendq;
+		e->env_ipc_sendq = src->env_ipc_sendlink;
+		src->env_ipc_waitfrom = 0;
+		ipc_send_done(src, -E_BAD_ENV);
+	}
+
+	// Callers waiting for our reply won't get one.
+	for (i = 0; i < NENV; i++)
+		if (envs[i].env_ipc_recving
+		    && envs[i].env_ipc_waitfrom == e->env_id) {
+			envs[i].env_ipc_recving = 0;
+			envs[i].env_ipc_waitfrom = 0;
+			ipc_wake(&envs[i], -E_BAD_ENV);
+		}
+
+	ipc_clear_deadline(e);
+	if (e->env_ipc_sendto)
+		ipc_dequeue(e);
+}
@@ -0,0 +1,29 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_IPC_H
+#define JOS_KERN_IPC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+struct Env;
+
+int	ipc_deliver(struct Env *src, struct Env *dst, uint32_t value,
+		    void *srcva, int perm);
+int	ipc_try_send(struct Env *src, struct Env *dst, uint32_t value,
+		     void *srcva, int perm);
+int	ipc_send(struct Env *src, struct Env *dst, uint32_t value,
+		 void *srcva, int perm);
+int	ipc_recv(struct Env *e, void *dstva, int npages, int timeout);
+void	ipc_notify(struct Env *dst, uint32_t bits);
+int	ipc_call(struct Env *src, struct Env *dst, uint32_t value,
+		 void *srcva, int perm, void *dstva, int npages, int timeout);
+int	ipc_reply_wait(struct Env *e, envid_t to, uint32_t value,
+		       void *srcva, int perm, void *dstva, int npages,
+		       int timeout);
+void	ipc_expire(void);
+void	ipc_remove(struct Env *e);
+
+#endif	// !JOS_KERN_IPC_H
@@ -1,6 +1,7 @@
 /* See COPYRIGHT for copyright information. */
 
-/* Support for reading the NVRAM from the real-time clock. */
+/* Support for reading the NVRAM from the real-time clock,
+ * and for timing short intervals with the PIT. */
 
 #include <inc/x86.h>
 
@@ -20,3 +21,33 @@ mc146818_write(unsigned reg, unsigned datum)
 	outb(IO_RTC, reg);
 	outb(IO_RTC+1, datum);
 }
+
+// Busy-wait 'usec' microseconds (at most about 54 ms), timed by PIT
+// counter 2.  That counter normally drives the PC speaker, so it is
+// free for us and, unlike counter 0, can be read back without
+// interrupts: its output shows up in bit 5 of port B.
+void
+pit_spin(unsigned usec)
+{
+	unsigned count = (unsigned long long) usec * TIMER_FREQ / 1000000;
+	uint8_t portb;
+
+	if (count > 0xffff)
+		count = 0xffff;
+
+	// Gate counter 2 on, with the speaker off.
+	portb = inb(IO_PORTB);
+	outb(IO_PORTB, (portb & ~0x02) | 0x01);
+
+	// Mode 0 (interrupt on terminal count), binary, LSB then MSB.
+	// Counting starts once the count is loaded, and the output goes
+	// high when it runs out.
+	outb(IO_TIMER + 3, 0xb0);
+	outb(IO_TIMER + 2, count & 0xff);
+	outb(IO_TIMER + 2, count >> 8);
+	while (!(inb(IO_PORTB) & 0x20))
+		;
+
+	outb(IO_PORTB, portb);
+}
+
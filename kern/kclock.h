@@ -26,7 +26,13 @@
 /* NVRAM byte 36: current century.  (please increment in Dec99!) */
 #define NVRAM_CENTURY	(MC_NVRAM_START + 36)	/* RTC offset 0x32 */
 
+/* The 8253/8254 programmable interval timer, used to calibrate other clocks */
+#define	IO_TIMER	0x040		/* PIT ports: counters 0-2 and mode */
+#define	IO_PORTB	0x061		/* system control port B */
+#define	TIMER_FREQ	1193182		/* PIT input clock, in Hz */
+
 unsigned mc146818_read(unsigned reg);
 void mc146818_write(unsigned reg, unsigned datum);
+void pit_spin(unsigned usec);
 
 #endif	// !JOS_KERN_KCLOCK_H
@@ -19,6 +19,24 @@ struct UserStabData {
 	const char *stabstr_end;
 };
 
+// The kernel's functions, sorted by address.  kdebug_init builds this
+// from the stabs once at boot, so that finding the function containing
+// a kernel address is a single binary search over a small table rather
+// than several over the whole stab table.  Functions beyond the first
+// NKSYMS are left to the stabs.
+#define NKSYMS		1024
+
+struct Ksym {
+	uintptr_t ks_addr;	// Address of the function's first instruction
+	uintptr_t ks_end;	// ...and just past its last
+	int ks_fun;		// Index of its N_FUN stab
+	int ks_fun_end;		// ...and of the next N_FUN stab after that
+	int ks_so;		// Index of its source file's N_SO stab
+};
+
+static struct Ksym ksyms[NKSYMS];
+static int nksyms;
+
 
 // stab_binsearch(stabs, region_left, region_right, type, addr)
 //
@@ -103,6 +121,115 @@ stab_binsearch(const struct Stab *stabs, int *region_left, int *region_right,
 }
 
 
+// kdebug_init()
+//
+//	Build the kernel function table from the kernel's stabs.
+//
+//	A function's N_FUN stab has its name and address; gcc follows its
+//	line stabs with an unnamed N_FUN whose value is the function's size.
+//	Functions come out in order within a source file, and source files
+//	mostly in link order, so sorting the table is cheap.
+//
+void
+kdebug_init(void)
+{
+	const struct Stab *stabs = __STAB_BEGIN__;
+	int nstabs = __STAB_END__ - __STAB_BEGIN__;
+	const char *name;
+	struct Ksym ks, *last = NULL;
+	int i, j, so = 0, dropped = 0;
+
+	for (i = 0; i < nstabs; i++) {
+		if (stabs[i].n_type == N_SO && stabs[i].n_strx) {
+			// Skip the directory stab that may precede the file's.
+			name = __STABSTR_BEGIN__ + stabs[i].n_strx;
+			if (name[0] && name[strlen(name) - 1] != '/')
+				so = i;
+			continue;
+		}
+		if (stabs[i].n_type != N_FUN)
+			continue;
+		if (last)
+			last->ks_fun_end = i;
+		if (!stabs[i].n_strx) {
+			if (last)
+				last->ks_end = last->ks_addr + stabs[i].n_value;
+			last = NULL;
+			continue;
+		}
+		if (nksyms == NKSYMS) {
+			dropped++;
+			last = NULL;
+			continue;
+		}
+		last = &ksyms[nksyms++];
+		last->ks_addr = stabs[i].n_value;
+		last->ks_end = 0;
+		last->ks_fun = i;
+		last->ks_fun_end = nstabs;
+		last->ks_so = so;
+	}
+
+	for (i = 1; i < nksyms; i++) {
+		ks = ksyms[i];
+		for (j = i; j > 0 && ksyms[j - 1].ks_addr > ks.ks_addr; j--)
+			ksyms[j] = ksyms[j - 1];
+		ksyms[j] = ks;
+	}
+	// Without a size, a function runs up to the next one.
+	for (i = 0; i < nksyms; i++)
+		if (!ksyms[i].ks_end)
+			ksyms[i].ks_end = (i + 1 < nksyms)
+				? ksyms[i + 1].ks_addr : ksyms[i].ks_addr + 1;
+
+	if (dropped)
+		cprintf("kdebug: %d functions beyond the first %d are slow to look up\n",
+			dropped, NKSYMS);
+}
+
+// Find the kernel function containing 'addr', or return NULL.
+static const struct Ksym *
+ksym_find(uintptr_t addr)
+{
+	int l = 0, r = nksyms - 1, m;
+
+	// Find the last function starting at or before 'addr'.
+	while (l <= r) {
+		m = (l + r) / 2;
+		if (ksyms[m].ks_addr <= addr)
+			l = m + 1;
+		else
+			r = m - 1;
+	}
+	if (r < 0 || addr >= ksyms[r].ks_end)
+		return NULL;
+	return &ksyms[r];
+}
+
+// debuginfo_fn(addr, info)
+//
+//	Like debuginfo_eip, but for a kernel function in the function
+//	table only fills in the function's name and address and the file
+//	it's in, leaving eip_line and eip_fn_narg 0.  That takes just one
+//	lookup, for callers that don't need line numbers.  Anything else
+//	goes to debuginfo_eip.
+//
+int
+debuginfo_fn(uintptr_t addr, struct Eipdebuginfo *info)
+{
+	const struct Ksym *ks;
+
+	if (addr < ULIM || !(ks = ksym_find(addr)))
+		return debuginfo_eip(addr, info);
+	info->eip_file = __STABSTR_BEGIN__ + __STAB_BEGIN__[ks->ks_so].n_strx;
+	info->eip_line = 0;
+	info->eip_fn_name = __STABSTR_BEGIN__ + __STAB_BEGIN__[ks->ks_fun].n_strx;
+	info->eip_fn_namelen = strfind(info->eip_fn_name, ':') - info->eip_fn_name;
+	info->eip_fn_addr = ks->ks_addr;
+	info->eip_fn_narg = 0;
+	return 0;
+}
+
 // debuginfo_eip(addr, info)
 //
 //	Fill in the 'info' structure with information about the specified
@@ -112,9 +239,23 @@ stab_binsearch(const struct Stab *stabs, int *region_left, int *region_right,
 //
 int
 debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
+{
+	return debuginfo_env_eip(curenv, addr, info);
+}
+
+// debuginfo_env_eip(e, addr, info)
+//
+//	Like debuginfo_eip, but looks user addresses up in environment e
+//	(which may be NULL, for none) rather than curenv.  e's address
+//	space must be the one loaded, and the strings in '*info' for user
+//	addresses only stay valid while it is.
+//
+int
+debuginfo_env_eip(struct Env *e, uintptr_t addr, struct Eipdebuginfo *info)
 {
 	const struct Stab *stabs, *stab_end;
 	const char *stabstr, *stabstr_end;
+	const struct Ksym *ks;
 	int lfile, rfile, lfun, rfun, lline, rline;
 
 	// Initialize *info
@@ -141,7 +282,7 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 
 		// Make sure this memory is valid.
 		// Return -1 if it is not.  Hint: Call user_mem_check.
-		if (user_mem_check(curenv, usd, sizeof(struct UserStabData), 0) < 0) {
+		if (!e || user_mem_check(e, usd, sizeof(struct UserStabData), 0) < 0) {
 			return -1;
 		}
 
@@ -151,10 +292,10 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 		stabstr_end = usd->stabstr_end;
 
 		// Make sure the STABS and string table memory is valid.
-		if (user_mem_check(curenv, stabs, (stab_end-stabs), 0) < 0) {
+		if (user_mem_check(e, stabs, (stab_end-stabs), 0) < 0) {
 			return -1;
 		}
-		if (user_mem_check(curenv, stabstr, (stabstr_end-stabstr), 0) < 0) {
+		if (user_mem_check(e, stabstr, (stabstr_end-stabstr), 0) < 0) {
 			return -1;
 		}
 	}
@@ -168,18 +309,26 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 	// Then, we look in that source file for the function.  Then we look
 	// for the line number.
 
-	// Search the entire set of stabs for the source file (type N_SO).
-	lfile = 0;
-	rfile = (stab_end - stabs) - 1;
-	stab_binsearch(stabs, &lfile, &rfile, N_SO, addr);
-	if (lfile == 0)
-		return -1;
+	// The kernel function table already knows both for most kernel
+	// addresses.
+	if (addr >= ULIM && (ks = ksym_find(addr))) {
+		lfile = ks->ks_so;
+		lfun = ks->ks_fun;
+		rfile = rfun = ks->ks_fun_end - 1;
+	} else {
+		// Search the entire set of stabs for the source file (type N_SO).
+		lfile = 0;
+		rfile = (stab_end - stabs) - 1;
+		stab_binsearch(stabs, &lfile, &rfile, N_SO, addr);
+		if (lfile == 0)
+			return -1;
 
-	// Search within that file's stabs for the function definition
-	// (N_FUN).
-	lfun = lfile;
-	rfun = rfile;
-	stab_binsearch(stabs, &lfun, &rfun, N_FUN, addr);
+		// Search within that file's stabs for the function definition
+		// (N_FUN).
+		lfun = lfile;
+		rfun = rfile;
+		stab_binsearch(stabs, &lfun, &rfun, N_FUN, addr);
+	}
 
 	if (lfun <= rfun) {
 		// stabs[lfun] points to the function name
@@ -0,0 +1,183 @@
+// Kernel event tracing (see inc/ktrace.h).
+//
+// Tracepoints throughout the kernel call KTRACE, which does nothing but
+// test ktrace_on until tracing is turned on.  Each CPU then logs into
+// its own ring, so logging takes no locks: a CPU only ever writes its
+// own ring, with interrupts off, and readers on other CPUs (the
+// monitor, or an environment with the rings mapped) check each slot's
+// sequence number instead.  The rings are allocated the first time
+// tracing is turned on or mapped, and kept from then on.
+
+#include <inc/x86.h>
+#include <inc/error.h>
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/cpu.h>
+#include <kern/ktrace.h>
+
+#define KTRACE_PERPAGE	(PGSIZE / sizeof(struct KtraceEvent))
+
+#define compiler_barrier()	__asm __volatile("" : : : "memory")
+
+bool ktrace_on;
+
+static struct KtraceCpu {
+	struct KtraceEvent *kc_page[KTRACE_NPAGES];
+	uint32_t kc_head;	// Events logged so far
+} ktrace_cpus[NCPU];
+
+static bool ktrace_ready;
+
+static const char * const ktrace_names[NKTRACE] = {
+	[KT_SWITCH] = "switch",
+	[KT_IDLE] = "idle",
+	[KT_PGFAULT] = "pgfault",
+	[KT_IPC_SEND] = "ipc_send",
+	[KT_IPC_RECV] = "ipc_recv",
+	[KT_ENV_CREATE] = "env_create",
+	[KT_ENV_DESTROY] = "env_destroy",
+	[KT_LOCK_SPIN] = "lock_spin",
+};
+
+static struct KtraceEvent *
+ktrace_slot(struct KtraceCpu *kc, uint32_t n)
+{
+	n %= KTRACE_NEVENTS;
+	return &kc->kc_page[n / KTRACE_PERPAGE][n % KTRACE_PERPAGE];
+}
+
+// Allocate every CPU's ring, if that hasn't been done yet.
+// Returns 0 on success, -E_NO_MEM if out of memory.
+static int
+ktrace_alloc(void)
+{
+	struct PageInfo *pp;
+	int i, j;
+
+	static_assert(PGSIZE % sizeof(struct KtraceEvent) == 0);
+
+	if (ktrace_ready)
+		return 0;
+	for (i = 0; i < ncpu; i++)
+		for (j = 0; j < KTRACE_NPAGES; j++) {
+			if (ktrace_cpus[i].kc_page[j])
+				continue;
+			if (!(pp = page_alloc(ALLOC_ZERO)))
+				return -E_NO_MEM;
+			pp->pp_ref++;
+			ktrace_cpus[i].kc_page[j] = page2kva(pp);
+		}
+	ktrace_ready = true;
+	return 0;
+}
+
+// Log an event on this CPU.  Use KTRACE rather than calling this.
+void
+ktrace_log(int type, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+	int cpu = cpunum();
+	struct KtraceCpu *kc = &ktrace_cpus[cpu];
+	uint32_t n = kc->kc_head;
+	struct KtraceEvent *ke = ktrace_slot(kc, n);
+
+	ke->ke_seq = 0;
+	compiler_barrier();
+	ke->ke_type = type;
+	ke->ke_cpu = cpu;
+	ke->ke_tsc = read_tsc();
+	ke->ke_env = curenv ? curenv->env_id : 0;
+	ke->ke_arg[0] = a0;
+	ke->ke_arg[1] = a1;
+	ke->ke_arg[2] = a2;
+	compiler_barrier();
+	ke->ke_seq = n + 1;
+	kc->kc_head = n + 1;
+}
+
+// Turn tracing on or off.
+// Returns 0 on success, -E_NO_MEM if there's no memory for the rings.
+int
+ktrace_enable(bool on)
+{
+	int r;
+
+	if (on && (r = ktrace_alloc()) < 0)
+		return r;
+	ktrace_on = on;
+	return 0;
+}
+
+// Map every CPU's ring read-only into e, one after another from 'va'.
+// Returns the number of CPUs on success, < 0 on error.  Errors are:
+//	-E_INVAL if va is not page-aligned, or the rings would run past UTOP.
+//	-E_NO_MEM if there's no memory for the rings or their page tables.
+//		Some rings may be mapped anyway.
+int
+ktrace_map(struct Env *e, void *va)
+{
+	int i, j, r;
+
+	if (PGOFF(va) || (uintptr_t) va >= UTOP
+	    || UTOP - (uintptr_t) va < ncpu * KTRACE_NPAGES * PGSIZE)
+		return -E_INVAL;
+	if ((r = ktrace_alloc()) < 0)
+		return r;
+	for (i = 0; i < ncpu; i++)
+		for (j = 0; j < KTRACE_NPAGES; j++) {
+			r = page_insert(e->env_pgdir,
+					pa2page(PADDR(ktrace_cpus[i].kc_page[j])),
+					va, PTE_P|PTE_U);
+			if (r < 0)
+				return r;
+			va += PGSIZE;
+		}
+	return ncpu;
+}
+
+// Print the events still in every CPU's ring, merged into one timeline.
+void
+ktrace_print(void)
+{
+	uint32_t pos[NCPU], end[NCPU];
+	struct KtraceEvent *ke, *next;
+	uint64_t start = 0;
+	int i, cpu = 0;
+
+	if (!ktrace_ready) {
+		cprintf("kernel tracing has never been on\n");
+		return;
+	}
+	// Stop at what's there now, in case other CPUs are still logging.
+	for (i = 0; i < ncpu; i++) {
+		end[i] = ktrace_cpus[i].kc_head;
+		pos[i] = end[i] > KTRACE_NEVENTS ? end[i] - KTRACE_NEVENTS : 0;
+	}
+
+	cprintf("%12s %3s %-8s  %-11s %s\n", "cycles", "cpu", "env", "event", "args");
+	while (1) {
+		next = NULL;
+		for (i = 0; i < ncpu; i++) {
+			if (pos[i] == end[i])
+				continue;
+			ke = ktrace_slot(&ktrace_cpus[i], pos[i]);
+			if (!next || ke->ke_tsc < next->ke_tsc) {
+				next = ke;
+				cpu = i;
+			}
+		}
+		if (!next)
+			break;
+		pos[cpu]++;
+
+		if (!start)
+			start = next->ke_tsc;
+		cprintf("%12llu %3d %08x  %-11s %08x %08x %08x\n",
+			next->ke_tsc - start, next->ke_cpu, next->ke_env,
+			next->ke_type < NKTRACE && ktrace_names[next->ke_type]
+			? ktrace_names[next->ke_type] : "?",
+			next->ke_arg[0], next->ke_arg[1], next->ke_arg[2]);
+	}
+	cprintf("kernel tracing is %s\n", ktrace_on ? "on" : "off");
+}
@@ -0,0 +1,30 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_KTRACE_H
+#define JOS_KERN_KTRACE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/ktrace.h>
+
+struct Env;
+
+extern bool ktrace_on;
+
+// Log a kernel event (see inc/ktrace.h) if tracing is on.  Off, this is
+// a load and a branch.
+#define KTRACE(type, a0, a1, a2)					\
+	do {								\
+		if (ktrace_on)						\
+			ktrace_log((type), (uint32_t) (a0),		\
+				   (uint32_t) (a1), (uint32_t) (a2));	\
+	} while (0)
+
+void	ktrace_log(int type, uint32_t a0, uint32_t a1, uint32_t a2);
+int	ktrace_enable(bool on);
+int	ktrace_map(struct Env *e, void *va);
+void	ktrace_print(void);
+
+#endif	// !JOS_KERN_KTRACE_H
@@ -9,6 +9,8 @@
 #include <inc/x86.h>
 #include <kern/pmap.h>
 #include <kern/cpu.h>
+#include <kern/kclock.h>
+#include <kern/time.h>
 
 // Local APIC registers, divided by 4 for use as uint32_t[] indices.
 #define ID      (0x0020/4)   // ID
@@ -45,6 +47,9 @@
 physaddr_t lapicaddr;        // Initialized in mpconfig.c
 volatile uint32_t *lapic;
 
+// Timer counts per clock tick (TICK_MSEC), measured at boot.
+static uint32_t lapic_tick_count;
+
 static void
 lapicw(int index, int value)
 {
@@ -52,6 +57,22 @@ lapicw(int index, int value)
 	lapic[ID];  // wait for write to finish, by reading
 }
 
+// Measure how far the timer counts down in one clock tick, using the PIT
+// as the reference.  The timer runs at the bus frequency, which varies
+// from machine to machine (and from one emulator to another).
+static uint32_t
+lapic_calibrate(void)
+{
+	uint32_t start;
+
+	lapicw(TDCR, X1);
+	lapicw(TIMER, MASKED);
+	lapicw(TICR, 0xffffffff);
+	start = lapic[TCCR];
+	pit_spin(TICK_MSEC * 1000);
+	return start - lapic[TCCR];
+}
+
 void
 lapic_init(void)
 {
@@ -66,12 +87,14 @@ lapic_init(void)
 	lapicw(SVR, ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS));
 
 	// The timer repeatedly counts down at bus frequency
-	// from lapic[TICR] and then issues an interrupt.  
-	// If we cared more about precise timekeeping,
-	// TICR would be calibrated using an external time source.
+	// from lapic[TICR] and then issues an interrupt.
+	// The boot CPU calibrates TICR against the PIT so that the
+	// interrupt comes every TICK_MSEC; the others share its result.
+	if (!lapic_tick_count)
+		lapic_tick_count = lapic_calibrate();
 	lapicw(TDCR, X1);
 	lapicw(TIMER, PERIODIC | (IRQ_OFFSET + IRQ_TIMER));
-	lapicw(TICR, 10000000); 
+	lapicw(TICR, lapic_tick_count);
 
 	// Leave LINT0 of the BSP enabled so that it can get
 	// interrupts from the 8259A chip.
@@ -134,8 +157,6 @@ microdelay(int us)
 {
 }
 
-#define IO_RTC  0x70
-
 // Start additional processor running entry code at addr.
 // See Appendix B of MultiProcessor Specification.
 void
@@ -6,11 +6,16 @@
 #include <inc/memlayout.h>
 #include <inc/assert.h>
 #include <inc/x86.h>
+#include <inc/vdso.h>
 
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/trap.h>
+#include <kern/env.h>
+#include <kern/prof.h>
+#include <kern/ktrace.h>
+#include <kern/perf.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -28,6 +33,11 @@ static struct Command commands[] = {
 	{ "backtrace", "Display the current stack backtrace", mon_backtrace },
 	{ "rainbow", "Display a rainbow of colorful text", mon_rainbow },
 	{ "dumptable", "Display a given page table (defaults to pgdir)", mon_dumptable },
+	{ "envstats", "Display an environment's system call and trap counters", mon_envstats },
+	{ "envtrace", "Display an environment's system call trace", mon_envtrace },
+	{ "prof", "Display the sampling profile (prof on|off|reset to control it)", mon_prof },
+	{ "ktrace", "Display kernel events (ktrace on|off to control tracing)", mon_ktrace },
+	{ "perf", "Display performance counts for the system, or an environment", mon_perf },
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -223,6 +233,127 @@ mon_dumptable(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+// Look up the environment whose hex ID is 'arg'.
+static struct Env *
+monitor_env(const char *arg)
+{
+	struct Env *e;
+
+	if (envid2env(strtol(arg, NULL, 16), &e, 0) < 0 || !e) {
+		cprintf("no environment %s\n", arg);
+		return NULL;
+	}
+	return e;
+}
+
+int
+mon_envstats(int argc, char **argv, struct Trapframe *tf)
+{
+	struct EnvStats *stats;
+	struct Env *e;
+	int i;
+
+	if (argc != 2) {
+		cprintf("usage: envstats <envid>\n");
+		return 0;
+	}
+	if (!(e = monitor_env(argv[1])))
+		return 0;
+	stats = &e->env_vdso->vd_stats;
+
+	cprintf("%-20s %10s %16s\n", "", "count", "cycles");
+	for (i = 0; i < NSYSCALLS; i++)
+		if (stats->es_syscalls[i])
+			cprintf("%-20s %10u %16llu\n", syscall_name(i),
+				stats->es_syscalls[i], stats->es_syscall_cycles[i]);
+	cprintf("%-20s %10u %16llu\n", "page faults",
+		stats->es_pgfaults, stats->es_pgfault_cycles);
+	cprintf("%-20s %10u\n", "  copy-on-write", stats->es_cowfaults);
+	cprintf("%-20s %10u %16llu\n", "interrupts",
+		stats->es_intrs, stats->es_intr_cycles);
+	return 0;
+}
+
+int
+mon_envtrace(int argc, char **argv, struct Trapframe *tf)
+{
+	struct TraceRing *tr;
+	struct TraceEntry *te;
+	struct Env *e;
+	uint32_t i, head;
+
+	if (argc != 2) {
+		cprintf("usage: envtrace <envid>\n");
+		return 0;
+	}
+	if (!(e = monitor_env(argv[1])))
+		return 0;
+	if (!(tr = e->env_trace)) {
+		cprintf("environment %08x is not traced\n", e->env_id);
+		return 0;
+	}
+
+	// The ring may be shared with other environments the same tracer
+	// watches; show all of it.
+	head = tr->tr_head;
+	i = head > TRACE_NENTRIES ? head - TRACE_NENTRIES : 0;
+	for (; i < head; i++) {
+		te = &tr->tr_ent[i % TRACE_NENTRIES];
+		cprintf("[%08x] %s(%x, %x, %x, %x, %x) = %d, %u cycles\n",
+			te->te_envid, syscall_name(te->te_num),
+			te->te_args[0], te->te_args[1], te->te_args[2],
+			te->te_args[3], te->te_args[4], te->te_ret, te->te_cycles);
+	}
+	return 0;
+}
+
+int
+mon_prof(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc == 1)
+		prof_print();
+	else if (argc == 2 && strcmp(argv[1], "on") == 0)
+		prof_enable(true);
+	else if (argc == 2 && strcmp(argv[1], "off") == 0)
+		prof_enable(false);
+	else if (argc == 2 && strcmp(argv[1], "reset") == 0)
+		prof_reset();
+	else
+		cprintf("usage: prof [on|off|reset]\n");
+	return 0;
+}
+
+int
+mon_ktrace(int argc, char **argv, struct Trapframe *tf)
+{
+	int r;
+
+	if (argc == 1)
+		ktrace_print();
+	else if (argc == 2 && strcmp(argv[1], "on") == 0) {
+		if ((r = ktrace_enable(true)) < 0)
+			cprintf("ktrace: %e\n", r);
+	} else if (argc == 2 && strcmp(argv[1], "off") == 0)
+		ktrace_enable(false);
+	else
+		cprintf("usage: ktrace [on|off]\n");
+	return 0;
+}
+
+int
+mon_perf(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Env *e = NULL;
+
+	if (argc > 2) {
+		cprintf("usage: perf [envid]\n");
+		return 0;
+	}
+	if (argc == 2 && !(e = monitor_env(argv[1])))
+		return 0;
+	perf_print(e);
+	return 0;
+}
 
 
 /***** Kernel monitor command interpreter *****/
@@ -17,5 +17,10 @@ int mon_kerninfo(int argc, char **argv, struct Trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct Trapframe *tf);
 int mon_rainbow(int argc, char **argv, struct Trapframe *tf);
 int mon_dumptable(int argc, char **argv, struct Trapframe *tf);
+int mon_envstats(int argc, char **argv, struct Trapframe *tf);
+int mon_envtrace(int argc, char **argv, struct Trapframe *tf);
+int mon_prof(int argc, char **argv, struct Trapframe *tf);
+int mon_ktrace(int argc, char **argv, struct Trapframe *tf);
+int mon_perf(int argc, char **argv, struct Trapframe *tf);
 
 #endif	// !JOS_KERN_MONITOR_H
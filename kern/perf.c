@@ -0,0 +1,184 @@
+// Hardware performance counters (see inc/perf.h).
+//
+// On CPUs with Intel's architectural performance monitoring, each CPU
+// programs general-purpose counter i to count event i, for as many
+// events as it has counters, and leaves them running.  Rather than
+// saving and reloading the counters themselves on every context switch,
+// env_run reads them as it switches environments and charges what they
+// counted since the last switch to the environment leaving the CPU, and
+// to the system-wide totals.  Counts are kept in 64 bits however wide
+// the counters are, as long as no counter wraps twice between switches.
+//
+// The totals and each CPU's last readings are only touched with the
+// big kernel lock held.
+
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/vdso.h>
+
+#include <kern/env.h>
+#include <kern/cpu.h>
+#include <kern/perf.h>
+
+#define EVTSEL_USR	(1 << 16)	// Count in user mode
+#define EVTSEL_OS	(1 << 17)	// Count in the kernel
+#define EVTSEL_EN	(1 << 22)	// Enable the counter
+
+// Event select and unit mask for each event.  The TLB event isn't
+// architectural; this is its encoding from Sandy Bridge on.
+static const uint32_t perf_evtsel[PERF_NEVENTS] = {
+	[PERF_CYCLES] = 0x003c,
+	[PERF_INSTRUCTIONS] = 0x00c0,
+	[PERF_CACHE_MISSES] = 0x412e,
+	[PERF_TLB_MISSES] = 0x0108,
+};
+
+// The bit in CPUID leaf 0xA's %ebx that says an architectural event is
+// missing, or -1 if the event isn't architectural.
+static const int perf_unavail_bit[PERF_NEVENTS] = {
+	[PERF_CYCLES] = 0,
+	[PERF_INSTRUCTIONS] = 1,
+	[PERF_CACHE_MISSES] = 4,
+	[PERF_TLB_MISSES] = -1,
+};
+
+static const char * const perf_names[PERF_NEVENTS] = {
+	[PERF_CYCLES] = "cycles",
+	[PERF_INSTRUCTIONS] = "instructions",
+	[PERF_CACHE_MISSES] = "cache misses",
+	[PERF_TLB_MISSES] = "TLB misses",
+};
+
+static bool perf_probed;
+static uint32_t perf_valid;	// Bit i set if event i is counted
+static int perf_version;	// Architectural perfmon version
+static uint64_t perf_mask;	// Bits the counters hold
+
+static uint64_t perf_last[NCPU][PERF_NEVENTS];
+static uint64_t perf_all[PERF_NEVENTS];
+
+// Work out which events the CPUs can count: the boot CPU's answer goes
+// for all of them.
+static void
+perf_probe(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+	int i, ncounters, width, nbits;
+
+	// "GenuineIntel", with leaf 0xA.
+	cpuid(0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0xA || ebx != 0x756e6547 || edx != 0x49656e69
+	    || ecx != 0x6c65746e)
+		return;
+	cpuid(0xA, &eax, &ebx, NULL, NULL);
+	perf_version = eax & 0xff;
+	ncounters = (eax >> 8) & 0xff;
+	width = (eax >> 16) & 0xff;
+	perf_mask = width < 64 ? (1ULL << width) - 1 : ~0ULL;
+	nbits = eax >> 24;
+	if (!perf_version)
+		return;
+
+	for (i = 0; i < PERF_NEVENTS && i < ncounters; i++)
+		if (perf_unavail_bit[i] < 0
+		    || (perf_unavail_bit[i] < nbits
+			&& !(ebx & (1 << perf_unavail_bit[i]))))
+			perf_valid |= 1 << i;
+}
+
+// Start this CPU's counters.
+void
+perf_init_percpu(void)
+{
+	int i;
+
+	// Probe on whichever CPU comes first, which is the boot CPU; the
+	// others only start once it has finished booting.
+	if (!perf_probed) {
+		perf_probe();
+		perf_probed = true;
+	}
+	for (i = 0; i < PERF_NEVENTS; i++) {
+		if (!(perf_valid & (1 << i)))
+			continue;
+		wrmsr(MSR_PERFEVTSEL0 + i, 0);
+		wrmsr(MSR_PMC0 + i, 0);
+		wrmsr(MSR_PERFEVTSEL0 + i,
+		      perf_evtsel[i] | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN);
+		perf_last[cpunum()][i] = 0;
+	}
+	if (perf_valid && perf_version >= 2)
+		wrmsr(MSR_PERF_GLOBAL_CTRL,
+		      rdmsr(MSR_PERF_GLOBAL_CTRL) | perf_valid);
+}
+
+// Charge what this CPU counted since the last time to e (if not NULL)
+// and to the system.
+static void
+perf_charge(struct Env *e)
+{
+	uint64_t *last = perf_last[cpunum()];
+	uint64_t now, delta;
+	int i;
+
+	for (i = 0; i < PERF_NEVENTS; i++) {
+		if (!(perf_valid & (1 << i)))
+			continue;
+		now = rdmsr(MSR_PMC0 + i);
+		delta = (now - last[i]) & perf_mask;
+		last[i] = now;
+		perf_all[i] += delta;
+		if (e && e->env_vdso)
+			e->env_vdso->vd_perf[i] += delta;
+	}
+}
+
+// Called as this CPU switches from environment prev to next (either
+// may be NULL).
+void
+perf_switch(struct Env *prev, struct Env *next)
+{
+	if (perf_valid && prev != next)
+		perf_charge(prev);
+}
+
+// Fill in 'pc' with e's counts and the system's.  curenv's are brought
+// up to date first; an environment running on another CPU's are as of
+// when it was last switched in.
+// Returns 0 on success, -E_NOT_SUPP if the CPU has no counters we use.
+int
+perf_read(struct Env *e, struct PerfCounts *pc)
+{
+	if (!perf_valid)
+		return -E_NOT_SUPP;
+	perf_charge(curenv);
+	pc->pc_valid = perf_valid;
+	memmove(pc->pc_env, e->env_vdso->vd_perf, sizeof(pc->pc_env));
+	memmove(pc->pc_all, perf_all, sizeof(pc->pc_all));
+	return 0;
+}
+
+// Print e's counts, or the system's if e is NULL.
+void
+perf_print(struct Env *e)
+{
+	const uint64_t *counts;
+	uint64_t ipc;
+	int i;
+
+	if (!perf_valid) {
+		cprintf("no performance counters\n");
+		return;
+	}
+	perf_charge(curenv);
+	counts = e ? e->env_vdso->vd_perf : perf_all;
+	for (i = 0; i < PERF_NEVENTS; i++)
+		if (perf_valid & (1 << i))
+			cprintf("%-14s %16llu\n", perf_names[i], counts[i]);
+	if ((perf_valid & 3) == 3 && counts[PERF_CYCLES]) {
+		ipc = counts[PERF_INSTRUCTIONS] * 100 / counts[PERF_CYCLES];
+		cprintf("%-14s %13llu.%02llu\n", "instr/cycle", ipc / 100, ipc % 100);
+	}
+}
@@ -0,0 +1,18 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PERF_H
+#define JOS_KERN_PERF_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/perf.h>
+
+struct Env;
+
+void	perf_init_percpu(void);
+void	perf_switch(struct Env *prev, struct Env *next);
+int	perf_read(struct Env *e, struct PerfCounts *pc);
+void	perf_print(struct Env *e);
+
+#endif	// !JOS_KERN_PERF_H
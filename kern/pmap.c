@@ -10,6 +10,8 @@
 #include <kern/kclock.h>
 #include <kern/env.h>
 #include <kern/cpu.h>
+#include <kern/futex.h>
+#include <kern/time.h>
 
 // These variables are set by i386_detect_memory()
 size_t npages;			// Amount of physical memory (in pages)
@@ -163,6 +165,11 @@ mem_init(void)
 	envs = (struct Env*) boot_alloc(NENV * sizeof(struct Env));
 	memset(envs, 0, (NENV * sizeof(struct Env)));
 
+	//////////////////////////////////////////////////////////////////////
+	// Make 'timepage' point to a page for the clock (see kern/time.c).
+	timepage = (struct TimePage*) boot_alloc(PGSIZE);
+	memset(timepage, 0, PGSIZE);
+
 	//////////////////////////////////////////////////////////////////////
 	// Now that we've allocated the initial kernel data structures, we set
 	// up the list of free physical pages. Once we've done so, all further
@@ -184,9 +191,15 @@ mem_init(void)
 	//    - the new image at UPAGES -- kernel R, user R
 	//      (ie. perm = PTE_U | PTE_P)
 	//    - pages itself -- kernel RW, user NONE
+	if (UPAGES + npages * sizeof(struct PageInfo) > UTIME)
+		panic("mem_init: too much memory for UPAGES");
 	boot_map_region(kern_pgdir, UPAGES, (npages * sizeof(struct PageInfo)), PADDR(pages), PTE_U);
 	boot_map_region(kern_pgdir, (uintptr_t)pages, (npages * sizeof(struct PageInfo)), PADDR(pages), PTE_W);
 
+	//////////////////////////////////////////////////////////////////////
+	// Map the clock page read-only by the user at linear address UTIME.
+	boot_map_region(kern_pgdir, UTIME, PGSIZE, PADDR(timepage), PTE_U);
+
 	//////////////////////////////////////////////////////////////////////
 	// Map the 'envs' array read-only by the user at linear address UENVS
 	// (ie. perm = PTE_U | PTE_P).
@@ -531,6 +544,9 @@ page_remove(pde_t *pgdir, void *va)
 	*entry = 0;
 
 	tlb_invalidate(pgdir, va);
+
+	// Let anyone blocked on this page notice that a sharer went away.
+	futex_wake_page(page2pa(page));
 }
 
 //
@@ -873,6 +889,9 @@ check_kern_pgdir(void)
 	for (i = 0; i < n; i += PGSIZE)
 		assert(check_va2pa(pgdir, UENVS + i) == PADDR(envs) + i);
 
+	// check clock page
+	assert(check_va2pa(pgdir, UTIME) == PADDR(timepage));
+
 	// check phys mem
 	for (i = 0; i < npages * PGSIZE; i += PGSIZE)
 		assert(check_va2pa(pgdir, KERNBASE + i) == i);
@@ -0,0 +1,179 @@
+// Statistical profiling.
+//
+// On every timer tick, each CPU records the EIP it was interrupted at,
+// and the environment it was running if the tick came from user mode,
+// in a buffer of its own.  Since the kernel runs with interrupts off,
+// kernel samples all come from CPUs idling in sched_halt.  Profiling
+// is on from boot, so that the monitor a finished run drops into can
+// show where the time went; once a CPU's buffer is full it just counts
+// the samples it drops, until "prof reset".
+//
+// prof_print turns the samples into a flat profile by function, using
+// kdebug's function table for kernel addresses and each environment's
+// own stabs for user ones.  The latter need the environment to still
+// exist.
+
+#include <inc/x86.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/cpu.h>
+#include <kern/kdebug.h>
+#include <kern/prof.h>
+
+#define PROF_NSAMPLES	2048	// Per CPU: 20 seconds' worth of ticks
+#define PROF_NFUNCS	128	// Functions prof_print can tell apart
+#define PROF_NAMELEN	32
+
+struct ProfSample {
+	uintptr_t ps_eip;
+	envid_t ps_env;		// Interrupted environment, or 0 for the kernel
+};
+
+static struct ProfCpu {
+	struct ProfSample pc_samples[PROF_NSAMPLES];
+	uint32_t pc_nsamples;
+	uint32_t pc_dropped;
+} prof_cpus[NCPU];
+
+static bool prof_on = true;
+
+// A function in the profile.  Samples that can't be resolved count
+// against a pf_addr of 0.
+struct ProfFunc {
+	envid_t pf_env;
+	uintptr_t pf_addr;
+	uint32_t pf_count;
+	char pf_name[PROF_NAMELEN];
+};
+
+static struct ProfFunc prof_funcs[PROF_NFUNCS];
+
+// Record where the timer interrupt 'tf' came from.
+void
+prof_tick(struct Trapframe *tf)
+{
+	struct ProfCpu *pc = &prof_cpus[cpunum()];
+	struct ProfSample *ps;
+
+	if (!prof_on)
+		return;
+	if (pc->pc_nsamples == PROF_NSAMPLES) {
+		pc->pc_dropped++;
+		return;
+	}
+	ps = &pc->pc_samples[pc->pc_nsamples];
+	ps->ps_eip = tf->tf_eip;
+	ps->ps_env = ((tf->tf_cs & 3) == 3 && curenv) ? curenv->env_id : 0;
+	pc->pc_nsamples++;
+}
+
+void
+prof_enable(bool on)
+{
+	prof_on = on;
+}
+
+// Throw away every CPU's samples.
+void
+prof_reset(void)
+{
+	int i;
+
+	for (i = 0; i < NCPU; i++)
+		prof_cpus[i].pc_nsamples = prof_cpus[i].pc_dropped = 0;
+}
+
+// Fill in which function 'ps' landed in.
+static void
+prof_resolve(const struct ProfSample *ps, struct ProfFunc *pf)
+{
+	struct Eipdebuginfo info;
+	struct Env *e = NULL;
+	uint32_t cr3 = rcr3();
+	int len;
+
+	pf->pf_env = ps->ps_env;
+	pf->pf_addr = 0;
+	strcpy(pf->pf_name, "<exited>");
+	if (ps->ps_env) {
+		if (envid2env(ps->ps_env, &e, 0) < 0)
+			return;
+		lcr3(PADDR(e->env_pgdir));
+	}
+
+	// The name may be in e's address space, so copy it out before
+	// switching back.
+	if (e)
+		debuginfo_env_eip(e, ps->ps_eip, &info);
+	else
+		debuginfo_fn(ps->ps_eip, &info);
+	len = MIN(info.eip_fn_namelen, PROF_NAMELEN - 1);
+	memmove(pf->pf_name, info.eip_fn_name, len);
+	pf->pf_name[len] = '\0';
+	if (strcmp(pf->pf_name, "<unknown>") != 0)
+		pf->pf_addr = info.eip_fn_addr;
+
+	if (e)
+		lcr3(cr3);
+}
+
+// Print a flat profile of the samples so far, busiest function first.
+void
+prof_print(void)
+{
+	struct ProfFunc pf, *f;
+	uint32_t total = 0, dropped = 0, other = 0;
+	int i, j, n, nfuncs = 0;
+
+	for (i = 0; i < NCPU; i++) {
+		struct ProfCpu *pc = &prof_cpus[i];
+
+		n = pc->pc_nsamples;
+		total += n;
+		dropped += pc->pc_dropped;
+		for (j = 0; j < n; j++) {
+			prof_resolve(&pc->pc_samples[j], &pf);
+			for (f = prof_funcs; f < prof_funcs + nfuncs; f++)
+				if (f->pf_env == pf.pf_env && f->pf_addr == pf.pf_addr
+				    && strcmp(f->pf_name, pf.pf_name) == 0)
+					break;
+			if (f == prof_funcs + PROF_NFUNCS) {
+				other++;
+				continue;
+			}
+			if (f == prof_funcs + nfuncs) {
+				*f = pf;
+				f->pf_count = 0;
+				nfuncs++;
+			}
+			f->pf_count++;
+		}
+	}
+
+	// Sort by count, descending.
+	for (i = 1; i < nfuncs; i++) {
+		pf = prof_funcs[i];
+		for (j = i; j > 0 && prof_funcs[j - 1].pf_count < pf.pf_count; j--)
+			prof_funcs[j] = prof_funcs[j - 1];
+		prof_funcs[j] = pf;
+	}
+
+	cprintf("%u samples, %u dropped%s\n", total, dropped,
+		prof_on ? "" : " (profiling is off)");
+	if (!total)
+		return;
+	cprintf("%8s %5s  %-10s %s\n", "samples", "%", "env", "function");
+	for (f = prof_funcs; f < prof_funcs + nfuncs; f++) {
+		cprintf("%8u %5u  ", f->pf_count, f->pf_count * 100 / total);
+		if (f->pf_env)
+			cprintf("%08x  ", f->pf_env);
+		else
+			cprintf("%-10s ", "kernel");
+		cprintf("%s\n", f->pf_name);
+	}
+	if (other)
+		cprintf("%8u %5u  (other functions)\n", other, other * 100 / total);
+}
@@ -0,0 +1,18 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PROF_H
+#define JOS_KERN_PROF_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+struct Trapframe;
+
+void	prof_tick(struct Trapframe *tf);
+void	prof_enable(bool on);
+void	prof_reset(void);
+void	prof_print(void);
+
+#endif	// !JOS_KERN_PROF_H
@@ -0,0 +1,128 @@
+// Kernel side of asynchronous system calls (see inc/ring.h).
+//
+// The kernel keeps its own reference to the ring page and reads and
+// writes it through its kernel address, so the environment unmapping
+// or remapping it can't make us fault.  Everything else on the page is
+// the environment's to scribble on: we copy each request before looking
+// at it, and only ever index the rings modulo RING_NSLOTS.
+//
+// Requests run with the owner's rights, so whoever can write the page
+// can make system calls as the owner.  We only run them while the owner
+// is the only environment with the page mapped, still writable at the
+// address it registered.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+#include <inc/syscall.h>
+#include <inc/ring.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/syscall.h>
+#include <kern/ring.h>
+
+// Use the page at 'va' in e's address space, which must be mapped
+// user-writable and nowhere else, as e's ring from now on, in place of
+// any earlier one.  A 'va' of NULL just drops e's ring.
+// Returns 0 on success, -E_INVAL if 'va' is unsuitable.
+int
+ring_setup(struct Env *e, void *va)
+{
+	struct PageInfo *pp = NULL;
+	pte_t *pte;
+
+	static_assert(sizeof(struct Ring) <= PGSIZE);
+
+	if (va) {
+		if ((uintptr_t) va >= UTOP || PGOFF(va))
+			return -E_INVAL;
+		pp = page_lookup(e->env_pgdir, va, &pte);
+		if (!pp || (*pte & (PTE_U|PTE_W)) != (PTE_U|PTE_W)
+		    || pp->pp_ref != 1)
+			return -E_INVAL;
+		pp->pp_ref++;
+	}
+	ring_remove(e);
+	e->env_ring = pp ? page2kva(pp) : NULL;
+	e->env_ring_va = va;
+	return 0;
+}
+
+// Whether only e can write to its ring: it still has the page mapped
+// writable where it set the ring up, and nobody else has it mapped.
+// Our own reference makes two.
+static bool
+ring_owned(struct Env *e)
+{
+	struct PageInfo *pp;
+	pte_t *pte;
+
+	pp = page_lookup(e->env_pgdir, e->env_ring_va, &pte);
+	return pp && page2kva(pp) == e->env_ring && (*pte & PTE_W)
+		&& pp->pp_ref == 2;
+}
+
+// Run one request for curenv.  Returns what the system call returned.
+static int
+ring_call(const struct RingSqe *sqe)
+{
+	const uint32_t *a = sqe->sqe_args;
+
+	switch (sqe->sqe_num) {
+		case SYS_ipc_try_send:
+			// It would never be received.
+			if (a[0] == 0 || a[0] == curenv->env_id)
+				return -E_INVAL;
+			/* fall through */
+		case SYS_page_alloc:
+		case SYS_page_map:
+		case SYS_page_unmap:
+			return syscall(sqe->sqe_num, a[0], a[1], a[2], a[3], a[4]);
+		default:
+			return -E_INVAL;
+	}
+}
+
+// Run curenv's queued requests, as long as there are completion slots
+// for their results and nobody else can write them.  Called on every
+// trap from user mode.
+void
+ring_run(void)
+{
+	struct Ring *r = curenv->env_ring;
+	struct RingSqe sqe;
+	struct RingCqe *cqe;
+	uint32_t head;
+	int n, ret;
+
+	if (!r || !ring_owned(curenv))
+		return;
+	// The environment can make its indices say anything, so don't
+	// trust them to end the loop.
+	for (n = 0; n < RING_NSLOTS; n++) {
+		head = r->r_sq_head;
+		if (head == r->r_sq_tail
+		    || r->r_cq_tail - r->r_cq_head >= RING_NSLOTS)
+			break;
+		sqe = r->r_sq[head % RING_NSLOTS];
+		// Leave a send to a receiver that isn't ready for next time.
+		if ((ret = ring_call(&sqe)) == -E_IPC_NOT_RECV)
+			break;
+		cqe = &r->r_cq[r->r_cq_tail % RING_NSLOTS];
+		cqe->cqe_data = sqe.sqe_data;
+		cqe->cqe_ret = ret;
+		r->r_cq_tail++;
+		r->r_sq_head = head + 1;
+	}
+}
+
+// Drop e's ring, if it has one.
+void
+ring_remove(struct Env *e)
+{
+	if (e->env_ring) {
+		page_decref(pa2page(PADDR(e->env_ring)));
+		e->env_ring = NULL;
+		e->env_ring_va = NULL;
+	}
+}
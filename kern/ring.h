@@ -0,0 +1,15 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_RING_H
+#define JOS_KERN_RING_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+struct Env;
+
+int	ring_setup(struct Env *e, void *va);
+void	ring_run(void);
+void	ring_remove(struct Env *e);
+
+#endif	// !JOS_KERN_RING_H
@@ -4,6 +4,9 @@
 #include <kern/env.h>
 #include <kern/pmap.h>
 #include <kern/monitor.h>
+#include <kern/fpu.h>
+#include <kern/ktrace.h>
+#include <kern/perf.h>
 
 void sched_halt(void);
 
@@ -56,7 +59,9 @@ sched_halt(void)
 	for (i = 0; i < NENV; i++) {
 		if ((envs[i].env_status == ENV_RUNNABLE ||
 		     envs[i].env_status == ENV_RUNNING ||
-		     envs[i].env_status == ENV_DYING))
+		     envs[i].env_status == ENV_DYING ||
+		     envs[i].env_futex_deadline ||
+		     envs[i].env_ipc_deadline))
 			break;
 	}
 	if (i == NENV) {
@@ -65,6 +70,12 @@ sched_halt(void)
 			monitor(NULL);
 	}
 
+	KTRACE(KT_IDLE, 0, 0, 0);
+	// curenv may have blocked and be woken on another CPU, so it must
+	// not leave its FPU state only in our registers.
+	fpu_switch(curenv, NULL);
+	perf_switch(curenv, NULL);
+
 	// Mark that no environment is running on this CPU
 	curenv = NULL;
 	lcr3(PADDR(kern_pgdir));
@@ -85,6 +96,6 @@ sched_halt(void)
 		"pushl $0\n"
 		"sti\n"
 		"hlt\n"
-	: : "a" (thiscpu->cpu_ts.ts_esp0));
+	: : "a" (thiscpu->cpu_kstacktop));
 }
 
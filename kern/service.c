@@ -0,0 +1,117 @@
+// Named services: servers register under a string name, and clients
+// look the name up to find the server's envid, instead of scanning
+// envs[] for an environment type.
+//
+// Names live in a small open-addressed hash table.  A name whose
+// server has gone away stays behind as a tombstone (sv_env == 0) so
+// that lookups of names further along its probe sequence still work;
+// registering the same name again reuses it.
+//
+// Clients trust the servers they find this way with their requests, so
+// the names of the system's own servers are reserved for environments
+// of the type the kernel gave those servers when it created them.
+
+#include <inc/error.h>
+#include <inc/string.h>
+
+#include <kern/env.h>
+#include <kern/service.h>
+
+#define NSERVICE	64	// must be a power of 2
+
+struct Service {
+	char sv_name[SERVICE_NAMELEN];	// empty if the slot was never used
+	envid_t sv_env;			// server, or 0 if it went away
+};
+
+static struct Service services[NSERVICE];
+
+// Names only environments of one type may register.
+static const struct {
+	const char *rs_name;
+	enum EnvType rs_type;
+} reserved[] = {
+	{ "fs", ENV_TYPE_FS },
+};
+#define NRESERVED (sizeof(reserved)/sizeof(reserved[0]))
+
+// FNV-1a
+static uint32_t
+service_hash(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (uint8_t) *name++) * 16777619u;
+	return h;
+}
+
+// Find the slot for 'name': the slot holding it, if any, and otherwise
+// the first reusable one along its probe sequence.
+// Returns NULL if the table is full and 'name' isn't in it.
+static struct Service *
+service_slot(const char *name)
+{
+	struct Service *sv, *free = NULL;
+	uint32_t h = service_hash(name);
+	int i;
+
+	for (i = 0; i < NSERVICE; i++) {
+		sv = &services[(h + i) % NSERVICE];
+		if (strcmp(sv->sv_name, name) == 0)
+			return sv;
+		if (!free && sv->sv_env == 0)
+			free = sv;
+		if (sv->sv_name[0] == '\0')
+			break;
+	}
+	return free;
+}
+
+// Register 'e' as the server for 'name', which must be a nonempty
+// string shorter than SERVICE_NAMELEN.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if the name is reserved for another type of environment.
+//	-E_NAME_EXISTS if another live environment has the name.
+//	-E_NO_MEM if there is no room for another name.
+int
+service_register(struct Env *e, const char *name)
+{
+	struct Service *sv;
+	int i;
+
+	for (i = 0; i < NRESERVED; i++)
+		if (strcmp(name, reserved[i].rs_name) == 0
+		    && e->env_type != reserved[i].rs_type)
+			return -E_BAD_ENV;
+	if (!(sv = service_slot(name)))
+		return -E_NO_MEM;
+	if (sv->sv_env && sv->sv_env != e->env_id)
+		return -E_NAME_EXISTS;
+	strcpy(sv->sv_name, name);
+	sv->sv_env = e->env_id;
+	return 0;
+}
+
+// Returns the envid registered as 'name', or -E_NOT_FOUND.
+envid_t
+service_lookup(const char *name)
+{
+	struct Service *sv = service_slot(name);
+
+	if (!sv || !sv->sv_env || strcmp(sv->sv_name, name) != 0)
+		return -E_NOT_FOUND;
+	return sv->sv_env;
+}
+
+// Drop the names 'e' registered, as it is being freed.
+void
+service_remove(struct Env *e)
+{
+	int i;
+
+	for (i = 0; i < NSERVICE; i++)
+		if (services[i].sv_env == e->env_id)
+			services[i].sv_env = 0;
+}
@@ -0,0 +1,17 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_SERVICE_H
+#define JOS_KERN_SERVICE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+struct Env;
+
+int	service_register(struct Env *e, const char *name);
+envid_t	service_lookup(const char *name);
+void	service_remove(struct Env *e);
+
+#endif	// !JOS_KERN_SERVICE_H
@@ -8,6 +8,7 @@
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
 #include <kern/kdebug.h>
+#include <kern/ktrace.h>
 
 // The big kernel lock
 struct spinlock kernel_lock = {
@@ -68,8 +69,13 @@ spin_lock(struct spinlock *lk)
 	// The xchg is atomic.
 	// It also serializes, so that reads after acquire are not
 	// reordered before it. 
-	while (xchg(&lk->locked, 1) != 0)
-		asm volatile ("pause");
+	if (xchg(&lk->locked, 1) != 0) {
+		uint64_t start = read_tsc();
+
+		while (xchg(&lk->locked, 1) != 0)
+			asm volatile ("pause");
+		KTRACE(KT_LOCK_SPIN, lk, read_tsc() - start, 0);
+	}
 
 	// Record info about lock acquisition for debugging.
 #ifdef DEBUG_SPINLOCK
@@ -4,6 +4,8 @@
 #include <inc/error.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/ring.h>
+#include <inc/vdso.h>
 
 #include <kern/env.h>
 #include <kern/pmap.h>
@@ -11,6 +13,15 @@
 #include <kern/syscall.h>
 #include <kern/console.h>
 #include <kern/sched.h>
+#include <kern/futex.h>
+#include <kern/time.h>
+#include <kern/ipc.h>
+#include <kern/service.h>
+#include <kern/ring.h>
+#include <kern/fpu.h>
+#include <kern/trace.h>
+#include <kern/ktrace.h>
+#include <kern/perf.h>
 
 // Print a string to the system console.
 // The string is exactly 'len' characters long.
@@ -88,6 +99,11 @@ sys_exofork(void)
 	// Copy registers, but set EAX to zero.
 	env->env_tf = curenv->env_tf;
 	env->env_tf.tf_regs.reg_eax = 0;
+	if ((success = fpu_fork(curenv, env)) < 0) {
+		env_free(env);
+		return success;
+	}
+	trace_fork(curenv, env);
 
 	return env->env_id;
 }
@@ -126,7 +142,9 @@ sys_env_set_status(envid_t envid, int status)
 //
 // Returns 0 on success, < 0 on error.  Errors are:
 //	-E_BAD_ENV if environment envid doesn't currently exist,
-//		or the caller doesn't have permission to change envid.
+//		or the caller doesn't have permission to change envid,
+//		or envid is running on another CPU, which may be writing
+//		its trap frame right now.
 static int
 sys_env_set_trapframe(envid_t envid, struct Trapframe *tf)
 {
@@ -137,6 +155,8 @@ sys_env_set_trapframe(envid_t envid, struct Trapframe *tf)
 	if (success) {
 		return success;
 	}
+	if (env->env_status == ENV_RUNNING && env != curenv)
+		return -E_BAD_ENV;
 	user_mem_assert(env, tf, sizeof(struct Trapframe), 0);
 
 	memmove(&env->env_tf, tf, sizeof(struct Trapframe));
@@ -353,7 +373,8 @@ sys_page_unmap(envid_t envid, void *va)
 //	-E_BAD_ENV if environment envid doesn't currently exist.
 //		(No need to check permissions.)
 //	-E_IPC_NOT_RECV if envid is not currently blocked in sys_ipc_recv,
-//		or another environment managed to send first.
+//		or another environment managed to send first,
+//		or envid is waiting for a reply from someone else.
 //	-E_INVAL if srcva < UTOP but srcva is not page-aligned.
 //	-E_INVAL if srcva < UTOP and perm is inappropriate
 //		(see sys_page_alloc).
@@ -366,7 +387,6 @@ sys_page_unmap(envid_t envid, void *va)
 static int
 sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 {
-	int ret_val = 0;
 	struct Env* env;
 
 	int success = envid2env(envid, &env, false);
@@ -374,35 +394,39 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 		return success;
 	}
 
-	if (!env->env_ipc_recving) {
-		return -E_IPC_NOT_RECV;
-	}
-	env->env_ipc_recving = 0;
-
-	void* dstva = env->env_ipc_dstva;
-	if ((uintptr_t)srcva < UTOP && (uintptr_t)dstva < UTOP) {
-		if (PGOFF(srcva) != 0) {
-			env->env_ipc_recving = 1;
-			return -E_INVAL;
-		}
+	KTRACE(KT_IPC_SEND, envid, value, SYS_ipc_try_send);
+	curenv->env_ipc_sendlen = 0;
+	curenv->env_ipc_sendpages = 1;
+	return ipc_try_send(curenv, env, value, srcva, perm);
+}
 
-		success = sys_page_map_worker(curenv, srcva, env, dstva, perm);
-		if (success < 0) {
-			env->env_ipc_recving = 1;
-			return success;
-		}
+// Send 'value' (and the page at 'srcva', as for sys_ipc_try_send) to
+// 'envid', blocking until it is received.  If the target isn't in
+// sys_ipc_recv yet, the caller sleeps in the target's queue of senders,
+// which it serves oldest first, instead of retrying.
+//
+// Returns 1 if a page was transferred, 0 if not, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or stops existing before it receives the message.
+//	-E_INVAL if envid is the caller itself (it would never return).
+//	-E_INVAL, -E_NO_MEM as for sys_ipc_try_send.
+static int
+sys_ipc_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
+{
+	struct Env* env;
 
-		env->env_ipc_perm = perm;
-		ret_val = 1;
+	int success = envid2env(envid, &env, false);
+	if (success < 0) {
+		return success;
 	}
-	else {
-		env->env_ipc_perm = 0;
+	if (env == curenv) {
+		return -E_INVAL;
 	}
 
-	env->env_ipc_from = curenv->env_id;
-	env->env_ipc_value = value;
-	env->env_status = ENV_RUNNABLE;
-	return ret_val;
+	KTRACE(KT_IPC_SEND, envid, value, SYS_ipc_send);
+	curenv->env_ipc_sendlen = 0;
+	curenv->env_ipc_sendpages = 1;
+	return ipc_send(curenv, env, value, srcva, perm);
 }
 
 // Block until a value is ready.  Record that you want to receive
@@ -412,26 +436,592 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 // If 'dstva' is < UTOP, then you are willing to receive a page of data.
 // 'dstva' is the virtual address at which the sent page should be mapped.
 //
+// If notifications are pending (see sys_ipc_notify), or senders are
+// already blocked in sys_ipc_send waiting for us, the notifications or
+// the oldest sender's message are received right away, without blocking.
+//
+// Give up after 'timeout' milliseconds; a negative 'timeout' waits
+// forever, and 0 only takes what is already there.
+//
 // This function only returns on error, but the system call will eventually
-// return 0 on success.
+// return 0 on success, or -E_TIMEOUT if the timeout expired first.
 // Return < 0 on error.  Errors are:
 //	-E_INVAL if dstva < UTOP but dstva is not page-aligned.
+//	-E_TIMEOUT if 'timeout' is 0 and nothing is waiting to be received.
 static int
-sys_ipc_recv(void *dstva)
+sys_ipc_recv(void *dstva, int timeout)
 {
 	if ((uintptr_t)dstva < UTOP && PGOFF(dstva) != 0) {
 		return -E_INVAL;
 	}
 
-	curenv->env_ipc_dstva = dstva;
-	curenv->env_ipc_recving = 1;
-	curenv->env_status = ENV_NOT_RUNNABLE;
+	KTRACE(KT_IPC_RECV, timeout, dstva, SYS_ipc_recv);
+	return ipc_recv(curenv, dstva, 1, timeout);
+}
+
+// Post the notification bits 'bits' to 'envid' without blocking.
+// The bits accumulate until 'envid' is in an open receive (sys_ipc_recv
+// or sys_ipc_reply_wait), which then returns them all at once as a
+// message with env_ipc_from 0 and env_ipc_value the bits, ahead of any
+// queued sender.  Any environment may notify any other, like sending.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist.
+//	-E_INVAL if bits is 0.
+static int
+sys_ipc_notify(envid_t envid, uint32_t bits)
+{
+	struct Env* env;
+
+	int success = envid2env(envid, &env, false);
+	if (success < 0) {
+		return success;
+	}
+	if (!bits) {
+		return -E_INVAL;
+	}
+
+	ipc_notify(env, bits);
+	return 0;
+}
+
+// Check a receive window of 'npages' pages at 'dstva' for
+// sys_ipc_call and sys_ipc_reply_wait.  dstva >= UTOP means no pages.
+// Returns 0 if it's OK, -E_INVAL if not.
+static int
+ipc_check_window(void *dstva, int npages)
+{
+	if ((uintptr_t)dstva >= UTOP) {
+		return 0;
+	}
+	if (PGOFF(dstva) != 0 || npages < 1 || npages > IPC_MAXPAGES
+	    || (uintptr_t)dstva + npages * PGSIZE > UTOP) {
+		return -E_INVAL;
+	}
+	return 0;
+}
+
+// Copy the IPC message at 'umsg' in the caller's address space: the
+// payload words and page count go into curenv->env_ipc_sendmsg and
+// env_ipc_sendpages, where ipc_deliver will find them, and the rest into
+// '*msg'.  Destroys the caller if 'umsg' isn't readable, like sys_cputs
+// does.
+//
+// Returns 0 on success, -E_INVAL if the message has too many words or
+// pages.
+static int
+ipc_copy_msg(const struct IpcMsg *umsg, struct IpcMsg *msg)
+{
+	user_mem_assert(curenv, umsg, offsetof(struct IpcMsg, im_words), PTE_U);
+	memmove(msg, umsg, offsetof(struct IpcMsg, im_words));
+	if (msg->im_nwords < 0 || msg->im_nwords > IPC_MSGWORDS
+	    || msg->im_npages < 0 || msg->im_npages > IPC_MAXPAGES) {
+		return -E_INVAL;
+	}
+	user_mem_assert(curenv, umsg->im_words,
+			msg->im_nwords * sizeof(uint32_t), PTE_U);
+	memmove(curenv->env_ipc_sendmsg, umsg->im_words,
+		msg->im_nwords * sizeof(uint32_t));
+	curenv->env_ipc_sendlen = msg->im_nwords;
+	curenv->env_ipc_sendpages = msg->im_npages;
+	return 0;
+}
+
+// Send the request in 'umsg' (see inc/ipc.h) to 'envid', as
+// sys_ipc_send does, and wait for its reply, which is received as by
+// sys_ipc_recv(dstva), except that up to 'npages' pages of it get mapped
+// at 'dstva' onwards.  Only 'envid' can deliver that reply; other
+// senders queue up meanwhile.  If 'envid' is already waiting for a
+// request, we switch to it directly rather than through the scheduler.
+// If the reply hasn't arrived within 'timeout' milliseconds (unless it is
+// negative), the call is abandoned: a request still queued is withdrawn,
+// and a late reply is dropped.
+//
+// Returns 0 once the reply has arrived, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or stops existing before it replies.
+//	-E_TIMEOUT if the timeout expired first.
+//	-E_INVAL if envid is the caller itself, or 'timeout' is 0.
+//	-E_INVAL if dstva < UTOP but dstva is not page-aligned, or 'npages'
+//		is not between 1 and IPC_MAXPAGES, or the pages run past UTOP.
+//	-E_INVAL if the message has more than IPC_MSGWORDS words or
+//		IPC_MAXPAGES pages.
+//	-E_INVAL, -E_NO_MEM as for ipc_deliver in kern/ipc.c.
+static int
+sys_ipc_call(envid_t envid, const struct IpcMsg *umsg, void *dstva,
+	     int npages, int timeout)
+{
+	struct Env* env;
+	struct IpcMsg msg;
+
+	if (ipc_check_window(dstva, npages) < 0 || timeout == 0) {
+		return -E_INVAL;
+	}
+	int success = envid2env(envid, &env, false);
+	if (success < 0) {
+		return success;
+	}
+	if (env == curenv) {
+		return -E_INVAL;
+	}
+	if ((success = ipc_copy_msg(umsg, &msg)) < 0) {
+		return success;
+	}
+
+	KTRACE(KT_IPC_SEND, envid, msg.im_value, SYS_ipc_call);
+	return ipc_call(curenv, env, msg.im_value, msg.im_srcva, msg.im_perm,
+			dstva, npages, timeout);
+}
+
+// For servers: reply to the sys_ipc_call of 'envid' with the message in
+// 'umsg' (unless 'envid' is 0), then wait for the next request, received
+// into a window of 'npages' pages at 'dstva' as by sys_ipc_call.
+// A reply that can't be delivered -- the caller is gone, or is not
+// waiting for us -- is dropped, so reply only to requests that arrived
+// with thisenv->env_ipc_fromcall set.  If no request is waiting, we switch
+// directly to the caller we just replied to.  'timeout' bounds the wait
+// for the next request as for sys_ipc_recv.
+//
+// Returns 0 once the next request has arrived, < 0 on error.  Errors are:
+//	-E_TIMEOUT if the timeout expired first (the reply still went out).
+//	-E_INVAL if the window at dstva is bad, as for sys_ipc_call.
+//	-E_INVAL if the reply has more than IPC_MSGWORDS words or
+//		IPC_MAXPAGES pages.
+static int
+sys_ipc_reply_wait(envid_t envid, const struct IpcMsg *umsg, void *dstva,
+		   int npages, int timeout)
+{
+	struct IpcMsg msg;
+	int success;
+
+	if (ipc_check_window(dstva, npages) < 0) {
+		return -E_INVAL;
+	}
+	if (!envid) {
+		KTRACE(KT_IPC_RECV, timeout, dstva, SYS_ipc_reply_wait);
+		return ipc_recv(curenv, dstva, npages, timeout);
+	}
+	if ((success = ipc_copy_msg(umsg, &msg)) < 0) {
+		return success;
+	}
+
+	KTRACE(KT_IPC_SEND, envid, msg.im_value, SYS_ipc_reply_wait);
+	KTRACE(KT_IPC_RECV, timeout, dstva, SYS_ipc_reply_wait);
+	return ipc_reply_wait(curenv, envid, msg.im_value, msg.im_srcva,
+			      msg.im_perm, dstva, npages, timeout);
+}
+
+// Block until another environment calls sys_futex_wake on 'addr',
+// provided the 32-bit word at 'addr' still holds 'expected'.
+// 'addr' may be any 4-byte aligned word the caller can read, including
+// shared pages and the read-only envs[] array.
+// If 'refs' is nonzero, also require that the page holding 'addr' is
+// mapped exactly 'refs' times (see pageref()).  Unmapping any mapping of
+// that page wakes all of its waiters.
+//
+// Like sys_ipc_recv, this only returns directly on error; once woken, the
+// system call returns 0.
+// Return < 0 on error.  Errors are:
+//	-E_AGAIN if the word at 'addr' does not hold 'expected',
+//		or the page's reference count does not match 'refs'.
+//	-E_INVAL if addr is not 4-byte aligned or is above ULIM.
+//	-E_FAULT if addr is not mapped in the caller's address space.
+static int
+sys_futex_wait(const uint32_t *addr, uint32_t expected, int refs)
+{
+	return futex_wait(curenv, addr, expected, refs);
+}
+
+// Wake up to 'n' environments blocked in sys_futex_wait on the same
+// physical word as 'addr', in the order in which they went to sleep.
+//
+// Returns the number of environments woken, < 0 on error.  Errors are:
+//	-E_INVAL if addr is not 4-byte aligned or is above ULIM.
+//	-E_FAULT if addr is not mapped in the caller's address space.
+static int
+sys_futex_wake(const uint32_t *addr, int n)
+{
+	if (n < 0)
+		return -E_INVAL;
+	return futex_wake(curenv, addr, n);
+}
+
+// Block until another environment wakes one of the 'n' words described
+// by 'w' (see inc/futex.h), or until 'timeout' milliseconds pass.
+// A negative 'timeout' waits forever.  This is sys_futex_wait for
+// several words at once, as poll() needs.
+//
+// Once woken, the system call returns the index in 'w' of the word
+// that was woken, or -E_TIMEOUT if the timeout expired first.
+// Otherwise, returns < 0 on error.  Errors are:
+//	-E_AGAIN if a word doesn't hold its fw_expected value,
+//		or a page's reference count doesn't match fw_refs.
+//	-E_TIMEOUT if 'timeout' is 0 (the words are still checked first).
+//	-E_INVAL if n < 0 or n > FUTEX_NWAIT, or an address is not 4-byte
+//		aligned or is above ULIM.
+//	-E_FAULT if an address is not mapped in the caller's address space.
+static int
+sys_futex_waitv(const struct FutexWait *uw, int n, int timeout)
+{
+	struct FutexWait w[FUTEX_NWAIT];
+
+	if (n < 0 || n > FUTEX_NWAIT)
+		return -E_INVAL;
+	user_mem_assert(curenv, uw, n * sizeof(w[0]), PTE_U);
+	memmove(w, uw, n * sizeof(w[0]));
+	return futex_waitv(curenv, w, n, timeout);
+}
+
+// Return the current time, in milliseconds since boot.
+static int
+sys_time_msec(void)
+{
+	return (int) time_msec();
+}
+
+// Store the current time, in nanoseconds since boot, at 'nsec'.
+// (User code can read the same clock without a system call: see
+// struct TimePage in inc/time.h.)
+// Destroys the caller if 'nsec' isn't writable, like sys_cputs does.
+// Returns 0.
+static int
+sys_time_nsec(uint64_t *nsec)
+{
+	user_mem_assert(curenv, nsec, sizeof(*nsec), PTE_U|PTE_W);
+	*nsec = time_nsec();
+	return 0;
+}
+
+// Let environments that share the page mapped at 'keyva' with the caller
+// hand it pages at [va, va+len) with sys_page_flip.  This is how a pipe
+// reader receives whole pages from a writer without copying them: the
+// key is the pipe's data page, so only the pipe's other end can send.
+// Calling again replaces the window; len == 0 closes it.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if va, len or keyva is not page-aligned, the window
+//		extends above UTOP, or keyva >= UTOP.
+static int
+sys_page_accept(void *va, size_t len, void *keyva)
+{
+	if (PGOFF(va) != 0 || PGOFF(len) != 0
+	    || (uintptr_t) va > UTOP || len > UTOP - (uintptr_t) va
+	    || (len && (PGOFF(keyva) != 0 || (uintptr_t) keyva >= UTOP))) {
+		return -E_INVAL;
+	}
+
+	curenv->env_accept_va = (uintptr_t) va;
+	curenv->env_accept_len = len;
+	curenv->env_accept_key = (uintptr_t) keyva;
 	return 0;
 }
 
+// Hand the page at 'srcva' to environment 'dstenvid' at 'dstva', which
+// must lie in the window dstenvid opened with sys_page_accept.  The
+// caller must map the window's key page at 'keyva'.  The page must not
+// be mapped anywhere else, and both the caller's mapping and the new
+// one get 'perm', which must not include PTE_W: neither side can write
+// the page without the other seeing it, so each must copy it first
+// (the pipe code marks both mappings PTE_COW for fork's fault handler).
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if dstenvid doesn't currently exist, dstva isn't in its
+//		window, or the caller doesn't map the key page at keyva.
+//	-E_INVAL if srcva, dstva or keyva is not page-aligned or >= UTOP.
+//	-E_INVAL if srcva is not mapped in the caller's address space,
+//		or is mapped somewhere else as well.
+//	-E_INVAL if perm lacks PTE_U or PTE_P, or has bits other than
+//		those and PTE_AVAIL.
+//	-E_NO_MEM if there's no memory to allocate any necessary page tables.
+static int
+sys_page_flip(void *srcva, envid_t dstenvid, void *dstva, void *keyva, int perm)
+{
+	struct Env *e;
+	struct PageInfo *pp, *key;
+	int r;
+
+	if ((uintptr_t) srcva >= UTOP || PGOFF(srcva) != 0
+	    || (uintptr_t) dstva >= UTOP || PGOFF(dstva) != 0
+	    || (uintptr_t) keyva >= UTOP || PGOFF(keyva) != 0)
+		return -E_INVAL;
+	if ((perm & (PTE_U|PTE_P)) != (PTE_U|PTE_P)
+	    || (perm & ~(PTE_U|PTE_P|PTE_AVAIL)) != 0)
+		return -E_INVAL;
+
+	if ((r = envid2env(dstenvid, &e, false)) < 0)
+		return r;
+	if ((uintptr_t) dstva < e->env_accept_va
+	    || (uintptr_t) dstva - e->env_accept_va >= e->env_accept_len)
+		return -E_BAD_ENV;
+	key = page_lookup(e->env_pgdir, (void *) e->env_accept_key, NULL);
+	if (!key || page_lookup(curenv->env_pgdir, keyva, NULL) != key)
+		return -E_BAD_ENV;
+
+	if (!(pp = page_lookup(curenv->env_pgdir, srcva, NULL))
+	    || pp->pp_ref != 1)
+		return -E_INVAL;
+	if ((r = page_insert(e->env_pgdir, pp, dstva, perm)) < 0)
+		return r;
+	// Only the permissions change, so this needs no memory.
+	return page_insert(curenv->env_pgdir, pp, srcva, perm);
+}
+
+// Copy the service name at 'uname', 'len' characters long, out of the
+// caller's address space into 'name' (SERVICE_NAMELEN bytes).
+// Destroys the caller if it can't read the name, like sys_cputs.
+// Returns 0 on success, -E_INVAL if the name is empty or too long.
+static int
+service_copy_name(char *name, const char *uname, size_t len)
+{
+	if (len == 0 || len >= SERVICE_NAMELEN) {
+		return -E_INVAL;
+	}
+	user_mem_assert(curenv, uname, len, PTE_U);
+	memmove(name, uname, len);
+	name[len] = '\0';
+	return 0;
+}
+
+// Register the caller as the server named by the 'len' characters at
+// 'name', so that clients can find it with sys_service_lookup.
+// The name goes away when the caller exits.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if the name is empty, or SERVICE_NAMELEN long or longer.
+//	-E_BAD_ENV if the name belongs to a system server (such as "fs")
+//		and the caller isn't that kind of environment.
+//	-E_NAME_EXISTS if another environment already has the name.
+//	-E_NO_MEM if there is no room for more names.
+static int
+sys_service_register(const char *name, size_t len)
+{
+	char kname[SERVICE_NAMELEN];
+	int r;
+
+	if ((r = service_copy_name(kname, name, len)) < 0) {
+		return r;
+	}
+	return service_register(curenv, kname);
+}
+
+// Look up the server registered under the 'len' characters at 'name'.
+//
+// Returns its envid on success, < 0 on error.  Errors are:
+//	-E_INVAL if the name is empty, or SERVICE_NAMELEN long or longer.
+//	-E_NOT_FOUND if no running environment has the name.
+static envid_t
+sys_service_lookup(const char *name, size_t len)
+{
+	char kname[SERVICE_NAMELEN];
+	int r;
+
+	if ((r = service_copy_name(kname, name, len)) < 0) {
+		return r;
+	}
+	return service_lookup(kname);
+}
+
+// Use the page at 'va', which must be mapped writable, as the caller's
+// ring for asynchronous system calls (see inc/ring.h), replacing any
+// earlier one.  The kernel keeps the page until the caller sets up
+// another ring or exits, but only runs requests while the page is
+// still mapped writable at va and nowhere else.  The caller should zero
+// the ring's indices first.  A 'va' of NULL drops the ring.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if va >= UTOP, or va is not page-aligned,
+//		or no writable page is mapped at va,
+//		or the page is mapped anywhere else too.
+static int
+sys_ring_setup(void *va)
+{
+	return ring_setup(curenv, va);
+}
+
+// Ring the doorbell on the caller's ring.  There is nothing left to do
+// by the time we get here: the kernel runs queued requests on every
+// trap, this one included.
+//
+// Returns the number of completions waiting to be collected, or
+// -E_INVAL if the caller has no ring.
+static int
+sys_ring_enter(void)
+{
+	struct Ring *r = curenv->env_ring;
+
+	if (!r)
+		return -E_INVAL;
+	return r->r_cq_tail - r->r_cq_head;
+}
+
+// Copy envid's counters (see inc/trace.h) to 'stats'.  Anyone may read
+// anyone's counters.  Destroys the caller if 'stats' isn't writable,
+// like sys_time_nsec does.
+//
+// Returns 0 on success, -E_BAD_ENV if envid doesn't currently exist.
+static int
+sys_env_stats(envid_t envid, struct EnvStats *stats)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 0)) < 0)
+		return r;
+	user_mem_assert(curenv, stats, sizeof(*stats), PTE_U|PTE_W);
+	memmove(stats, &e->env_vdso->vd_stats, sizeof(*stats));
+	return 0;
+}
+
+// Trace envid's system calls (see inc/trace.h) into the ring on the
+// page at 'va' in the caller's address space, which must be mapped
+// writable, replacing any earlier ring.  The kernel holds on to the page
+// while envid, or any child it creates from now on, is traced into it.
+// A 'va' of NULL stops tracing envid.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if va >= UTOP, or va is not page-aligned,
+//		or no writable page is mapped at va.
+static int
+sys_env_trace(envid_t envid, void *va)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	return trace_setup(e, curenv, va);
+}
+
+// Only environments the kernel started itself at boot (the file server
+// and the first user program) may control or read the kernel event
+// trace.
+static bool
+ktrace_allowed(void)
+{
+	return curenv->env_parent_id == 0;
+}
+
+// Turn kernel event tracing (see inc/ktrace.h) on or off.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_NO_PERM if the caller may not use the kernel event trace.
+//	-E_NO_MEM if there's no memory for the trace rings.
+static int
+sys_ktrace(int on)
+{
+	if (!ktrace_allowed())
+		return -E_NO_PERM;
+	return ktrace_enable(on);
+}
+
+// Map every CPU's kernel event trace ring read-only into the caller,
+// KTRACE_NPAGES pages each, one after another from 'va'.  Tracing need
+// not be on.
+//
+// Returns the number of CPUs on success, < 0 on error.  Errors are:
+//	-E_NO_PERM if the caller may not use the kernel event trace.
+//	-E_INVAL if va is not page-aligned, or the rings would run past UTOP.
+//	-E_NO_MEM if there's no memory for the rings or their page tables.
+static int
+sys_ktrace_map(void *va)
+{
+	if (!ktrace_allowed())
+		return -E_NO_PERM;
+	return ktrace_map(curenv, va);
+}
+
+// Copy envid's hardware performance counts (see inc/perf.h), and the
+// whole system's, to 'pc'.  Anyone may read anyone's counts.  Destroys
+// the caller if 'pc' isn't writable, like sys_env_stats does.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist.
+//	-E_NOT_SUPP if the CPU has no performance counters we can use.
+static int
+sys_perf_read(envid_t envid, struct PerfCounts *pc)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 0)) < 0)
+		return r;
+	user_mem_assert(curenv, pc, sizeof(*pc), PTE_U|PTE_W);
+	return perf_read(e, pc);
+}
+
+// Whether system call 'num' may run inside sys_batch: only calls that
+// are known never to block or yield the CPU, since those would leave the
+// rest of the batch half done and put their results in the caller's %eax
+// rather than sd_ret.  Anything not listed here, including calls added
+// later, is refused until someone checks it.
+static bool
+batchable(uint32_t num)
+{
+	switch (num) {
+		case SYS_cputs:
+		case SYS_getenvid:
+		case SYS_page_alloc:
+		case SYS_page_map:
+		case SYS_page_unmap:
+		case SYS_page_accept:
+		case SYS_page_flip:
+		case SYS_env_set_status:
+		case SYS_env_set_trapframe:
+		case SYS_env_set_pgfault_upcall:
+		case SYS_ipc_try_send:
+		case SYS_ipc_notify:
+		case SYS_futex_wake:
+		case SYS_service_register:
+		case SYS_service_lookup:
+		case SYS_time_msec:
+		case SYS_time_nsec:
+		case SYS_env_stats:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Run the 'n' system calls described by 'ud' (see inc/syscall.h) in
+// order, storing each one's return value in its sd_ret.  A call that
+// batchable() doesn't allow fails with -E_INVAL without running.
+// If 'flags' includes BATCH_STOP, stop after the first call that fails.
+// Destroys the caller if part of 'ud' that we reach isn't writable,
+// including when an earlier call in the batch unmapped it.
+//
+// Returns the number of calls run, counting the one that failed if
+// the batch stopped early.  Otherwise returns < 0 on error.  Errors are:
+//	-E_INVAL if n < 0 or n > BATCH_MAX, or 'flags' is invalid.
+static int
+sys_batch(struct SyscallDesc *ud, int n, int flags)
+{
+	struct SyscallDesc d;
+	int i;
+
+	if (n < 0 || n > BATCH_MAX || (flags & ~BATCH_STOP))
+		return -E_INVAL;
+	for (i = 0; i < n; ) {
+		user_mem_assert(curenv, &ud[i], sizeof(d), PTE_U|PTE_W);
+		d = ud[i];
+		if (batchable(d.sd_num))
+			d.sd_ret = syscall(d.sd_num, d.sd_args[0], d.sd_args[1],
+					   d.sd_args[2], d.sd_args[3],
+					   d.sd_args[4]);
+		else
+			d.sd_ret = -E_INVAL;
+		user_mem_assert(curenv, &ud[i], sizeof(d), PTE_U|PTE_W);
+		ud[i++].sd_ret = d.sd_ret;
+		if (d.sd_ret < 0 && (flags & BATCH_STOP))
+			break;
+	}
+	return i;
+}
+
 // Dispatches to the correct kernel function, passing the arguments.
-int32_t
-syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
+static int32_t
+syscall_dispatch(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
 {
 	// Call the function corresponding to the 'syscallno' parameter.
 	// Return any appropriate return value.
@@ -464,11 +1054,80 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 			return sys_page_unmap(a1, (void*)a2);
 		case SYS_ipc_try_send:
 			return sys_ipc_try_send(a1, a2, (void*)a3, a4);
+		case SYS_ipc_send:
+			return sys_ipc_send(a1, a2, (void*)a3, a4);
+		case SYS_ipc_call:
+			return sys_ipc_call(a1, (const struct IpcMsg*)a2, (void*)a3, a4, a5);
+		case SYS_ipc_reply_wait:
+			return sys_ipc_reply_wait(a1, (const struct IpcMsg*)a2, (void*)a3, a4, a5);
 		case SYS_ipc_recv:
-			return sys_ipc_recv((void*)a1);
+			return sys_ipc_recv((void*)a1, a2);
+		case SYS_ipc_notify:
+			return sys_ipc_notify(a1, a2);
+		case SYS_futex_wait:
+			return sys_futex_wait((const uint32_t*)a1, a2, a3);
+		case SYS_futex_wake:
+			return sys_futex_wake((const uint32_t*)a1, a2);
+		case SYS_page_accept:
+			return sys_page_accept((void*)a1, a2, (void*)a3);
+		case SYS_page_flip:
+			return sys_page_flip((void*)a1, a2, (void*)a3, (void*)a4, a5);
+		case SYS_futex_waitv:
+			return sys_futex_waitv((const struct FutexWait*)a1, a2, a3);
+		case SYS_time_msec:
+			return sys_time_msec();
+		case SYS_time_nsec:
+			return sys_time_nsec((uint64_t*)a1);
+		case SYS_service_register:
+			return sys_service_register((const char*)a1, a2);
+		case SYS_service_lookup:
+			return sys_service_lookup((const char*)a1, a2);
+		case SYS_batch:
+			return sys_batch((struct SyscallDesc*)a1, a2, a3);
+		case SYS_ring_setup:
+			return sys_ring_setup((void*)a1);
+		case SYS_ring_enter:
+			return sys_ring_enter();
+		case SYS_env_stats:
+			return sys_env_stats(a1, (struct EnvStats*)a2);
+		case SYS_env_trace:
+			return sys_env_trace(a1, (void*)a2);
+		case SYS_ktrace:
+			return sys_ktrace(a1);
+		case SYS_ktrace_map:
+			return sys_ktrace_map((void*)a1);
+		case SYS_perf_read:
+			return sys_perf_read(a1, (struct PerfCounts*)a2);
 		default:
 			return -E_INVAL;
 	}
 
 	panic("syscall not implemented");
 }
+
+// Runs system call 'syscallno' for curenv, counting it, and the cycles
+// it took, in curenv's statistics, and tracing it if curenv is traced.
+// Calls that never return here (sys_yield, say) are counted and traced,
+// but not timed.
+int32_t
+syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
+{
+	struct Env *e = curenv;
+	struct EnvStats *stats = &e->env_vdso->vd_stats;
+	struct TraceEntry *te;
+	uint64_t start, cycles;
+	int32_t ret;
+
+	start = read_tsc();
+	if (syscallno < NSYSCALLS)
+		stats->es_syscalls[syscallno]++;
+	te = trace_begin(e, syscallno, a1, a2, a3, a4, a5);
+
+	ret = syscall_dispatch(syscallno, a1, a2, a3, a4, a5);
+
+	cycles = read_tsc() - start;
+	if (syscallno < NSYSCALLS)
+		stats->es_syscall_cycles[syscallno] += cycles;
+	trace_end(e, te, ret, cycles);
+	return ret;
+}
@@ -0,0 +1,54 @@
+#include <inc/x86.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kern/time.h>
+#include <kern/kclock.h>
+
+// How long to time the TSC against the PIT at boot.  Longer is more
+// accurate, up to pit_spin's limit of about 54 ms.
+#define CALIBRATE_USEC	50000
+
+static unsigned int ticks;
+
+struct TimePage *timepage;
+
+// Start the clocks at 0, and measure the TSC's frequency with the PIT so
+// that TSC readings can be turned into real time.
+void
+time_init(void)
+{
+	uint64_t start;
+
+	ticks = 0;
+	start = read_tsc();
+	pit_spin(CALIBRATE_USEC);
+	timepage->tp_tsc_khz = (read_tsc() - start) / (CALIBRATE_USEC / 1000);
+	timepage->tp_tsc_boot = read_tsc();
+	cprintf("TSC: %u kHz\n", timepage->tp_tsc_khz);
+}
+
+// This should be called once per timer interrupt.  A timer interrupt
+// fires every TICK_MSEC ms (see lapic_init).
+void
+time_tick(void)
+{
+	ticks++;
+	if (ticks * TICK_MSEC < ticks)
+		panic("time_tick: time overflowed");
+}
+
+unsigned int
+time_msec(void)
+{
+	return (unsigned int) ticks * TICK_MSEC;
+}
+
+// Nanoseconds since boot, from the calibrated TSC.  Unlike time_msec,
+// this is good between ticks, and on every CPU.
+uint64_t
+time_nsec(void)
+{
+	return tsc_to_nsec(read_tsc() - timepage->tp_tsc_boot,
+			   timepage->tp_tsc_khz);
+}
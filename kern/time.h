@@ -0,0 +1,19 @@
+#ifndef JOS_KERN_TIME_H
+#define JOS_KERN_TIME_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/time.h>
+
+// Milliseconds between clock ticks (LAPIC timer interrupts).
+#define TICK_MSEC	10
+
+extern struct TimePage *timepage;	// The clock page, mapped at UTIME
+
+void time_init(void);
+void time_tick(void);
+unsigned int time_msec(void);
+uint64_t time_nsec(void);
+
+#endif /* JOS_KERN_TIME_H */
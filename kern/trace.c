@@ -0,0 +1,102 @@
+// System call tracing (see inc/trace.h).
+//
+// A traced environment's records go to a ring on a page of its
+// tracer's, which the kernel holds a reference to and writes through
+// its kernel address, as for the rings in kern/ring.c.  Children made
+// with sys_exofork are traced into the same ring, so a tracer that
+// traces itself while it spawns a program catches the program from its
+// first instruction, and everything the program starts in turn.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+#include <inc/trace.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/trace.h>
+
+// Trace e's system calls into the ring on the page at 'va' in tracer's
+// address space, which must be mapped user-writable, in place of any
+// earlier ring.  A 'va' of NULL stops tracing e.
+// Returns 0 on success, -E_INVAL if 'va' is unsuitable.
+int
+trace_setup(struct Env *e, struct Env *tracer, void *va)
+{
+	struct PageInfo *pp = NULL;
+	pte_t *pte;
+
+	static_assert(sizeof(struct TraceRing) <= PGSIZE);
+
+	if (va) {
+		if ((uintptr_t) va >= UTOP || PGOFF(va))
+			return -E_INVAL;
+		pp = page_lookup(tracer->env_pgdir, va, &pte);
+		if (!pp || (*pte & (PTE_U|PTE_W)) != (PTE_U|PTE_W))
+			return -E_INVAL;
+		pp->pp_ref++;
+	}
+	trace_remove(e);
+	e->env_trace = pp ? page2kva(pp) : NULL;
+	return 0;
+}
+
+// Trace 'child' wherever 'parent' is traced.
+void
+trace_fork(struct Env *parent, struct Env *child)
+{
+	if (parent->env_trace) {
+		pa2page(PADDR(parent->env_trace))->pp_ref++;
+		child->env_trace = parent->env_trace;
+	}
+}
+
+// Stop tracing e.
+void
+trace_remove(struct Env *e)
+{
+	if (e->env_trace) {
+		page_decref(pa2page(PADDR(e->env_trace)));
+		e->env_trace = NULL;
+	}
+}
+
+// Record that e is making system call 'num'.  Returns the record, to
+// pass to trace_end once the call returns, or NULL if e isn't traced.
+struct TraceEntry *
+trace_begin(struct Env *e, uint32_t num, uint32_t a1, uint32_t a2,
+	    uint32_t a3, uint32_t a4, uint32_t a5)
+{
+	struct TraceRing *r = e->env_trace;
+	struct TraceEntry *te;
+	uint32_t head;
+
+	if (!r)
+		return NULL;
+	head = r->tr_head;
+	te = &r->tr_ent[head % TRACE_NENTRIES];
+	te->te_envid = e->env_id;
+	te->te_num = num;
+	te->te_args[0] = a1;
+	te->te_args[1] = a2;
+	te->te_args[2] = a3;
+	te->te_args[3] = a4;
+	te->te_args[4] = a5;
+	te->te_ret = 0;
+	te->te_cycles = 0;
+	r->tr_head = head + 1;
+	return te;
+}
+
+// Fill in what the call traced by 'te' returned, and how long it took.
+void
+trace_end(struct Env *e, struct TraceEntry *te, int32_t ret, uint64_t cycles)
+{
+	struct TraceRing *r = e->env_trace;
+
+	// The call may have been the one that stopped e's tracing, in
+	// which case 'te' is in a page we may no longer hold.
+	if (!te || !r || te < r->tr_ent || te >= r->tr_ent + TRACE_NENTRIES)
+		return;
+	te->te_ret = ret;
+	te->te_cycles = cycles;
+}
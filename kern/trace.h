@@ -0,0 +1,23 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_TRACE_H
+#define JOS_KERN_TRACE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+struct Env;
+struct TraceEntry;
+
+int	trace_setup(struct Env *e, struct Env *tracer, void *va);
+void	trace_fork(struct Env *parent, struct Env *child);
+void	trace_remove(struct Env *e);
+struct TraceEntry *trace_begin(struct Env *e, uint32_t num, uint32_t a1,
+			       uint32_t a2, uint32_t a3, uint32_t a4,
+			       uint32_t a5);
+void	trace_end(struct Env *e, struct TraceEntry *te, int32_t ret,
+		  uint64_t cycles);
+
+#endif	// !JOS_KERN_TRACE_H
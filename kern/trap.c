@@ -1,6 +1,7 @@
 #include <inc/mmu.h>
 #include <inc/x86.h>
 #include <inc/assert.h>
+#include <inc/vdso.h>
 
 #include <kern/pmap.h>
 #include <kern/trap.h>
@@ -13,6 +14,14 @@
 #include <kern/picirq.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/time.h>
+#include <kern/futex.h>
+#include <kern/ipc.h>
+#include <kern/ring.h>
+#include <kern/fpu.h>
+#include <kern/prof.h>
+#include <kern/ktrace.h>
+#include <kern/perf.h>
 
 static struct Taskstate ts;
 
@@ -60,6 +69,8 @@ static const char *trapname(int trapno)
 		return excnames[trapno];
 	if (trapno == T_SYSCALL)
 		return "System call";
+	if (trapno == T_SYSENTER)
+		return "System call (sysenter)";
 	if (trapno >= IRQ_OFFSET && trapno < IRQ_OFFSET + 16)
 		return "Hardware Interrupt";
 	return "(unknown trap)";
@@ -114,6 +125,7 @@ extern void int45();
 extern void int46();
 extern void int47();
 extern void int48();	// syscall
+extern void sysenter_handler();
 
 void
 trap_init(void)
@@ -178,6 +190,8 @@ trap_init(void)
 void
 trap_init_percpu(void)
 {
+	uint32_t edx;
+
 	// The example code here sets up the Task State Segment (TSS) and
 	// the TSS descriptor for CPU 0. But it is incorrect if we are
 	// running on other CPUs because each CPU has its own kernel stack.
@@ -201,7 +215,10 @@ trap_init_percpu(void)
 
 	// Setup a TSS so that we get the right stack
 	// when we trap to the kernel.
-	thiscpu->cpu_ts.ts_esp0 = (KSTACKTOP - cpunum() * (KSTKSIZE + KSTKGAP));
+	// (env_pop_tf points esp0 at the environment it is about to run;
+	// see _alltraps.)
+	thiscpu->cpu_kstacktop = KSTACKTOP - cpunum() * (KSTKSIZE + KSTKGAP);
+	thiscpu->cpu_ts.ts_esp0 = thiscpu->cpu_kstacktop;
 	thiscpu->cpu_ts.ts_ss0 = GD_KD;
 
 	// Initialize the TSS slot of the gdt.
@@ -215,6 +232,26 @@ trap_init_percpu(void)
 
 	// Load the IDT
 	lidt(&idt_pd);
+
+	// Set up sysenter.  Its stack pointer is the address of esp0 in
+	// this CPU's TSS, which sysenter_handler loads %esp from, so that
+	// it finds the same place a trap would.  sysenter and sysexit
+	// derive the other three segments from the kernel CS, which the
+	// GDT lays out in the order they expect: GD_KT, GD_KD, GD_UT, GD_UD.
+	// A #DB right after sysenter pushes three words below esp0 (see
+	// int1 in trapentry.S), which must land in ts_link and cpu_sescratch.
+	static_assert(offsetof(struct Taskstate, ts_esp0) == 4);
+	static_assert(offsetof(struct CpuInfo, cpu_ts)
+		      == offsetof(struct CpuInfo, cpu_sescratch) + 8);
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (edx & CPUID_FEAT_SEP) {
+		wrmsr(MSR_SYSENTER_CS, GD_KT);
+		wrmsr(MSR_SYSENTER_ESP, (uint32_t) &thiscpu->cpu_ts.ts_esp0);
+		wrmsr(MSR_SYSENTER_EIP, (uint32_t) sysenter_handler);
+	}
+
+	fpu_init_percpu();
+	perf_init_percpu();
 }
 
 void
@@ -263,9 +300,25 @@ print_regs(struct PushRegs *regs)
 	cprintf("  eax  0x%08x\n", regs->reg_eax);
 }
 
+// Count a device interrupt that arrived at 'start', and the cycles
+// since, against the environment it interrupted.
+static void
+intr_account(struct Trapframe *tf, uint64_t start)
+{
+	struct EnvStats *stats;
+
+	if ((tf->tf_cs & 3) != 3 || !curenv)
+		return;
+	stats = &curenv->env_vdso->vd_stats;
+	stats->es_intrs++;
+	stats->es_intr_cycles += read_tsc() - start;
+}
+
 static void
 trap_dispatch(struct Trapframe *tf)
 {
+	uint64_t start = read_tsc();
+
 	// Handle processor exceptions.
 	uint32_t ret;
 	switch (tf->tf_trapno) {
@@ -275,11 +328,22 @@ trap_dispatch(struct Trapframe *tf)
 		case T_PGFLT:
 			page_fault_handler(tf);
 			return;
+		case T_DEVICE:
+			if (fpu_trap(tf) == 0)
+				return;
+			break;
 		case T_SYSCALL:
 			ret = syscall(tf->tf_regs.reg_eax, tf->tf_regs.reg_edx, tf->tf_regs.reg_ecx,
 										tf->tf_regs.reg_ebx, tf->tf_regs.reg_edi, tf->tf_regs.reg_esi);
 			tf->tf_regs.reg_eax = ret;
 			return;
+		case T_SYSENTER:
+			// %esi carried the return address, so there is no fifth
+			// argument; lib/syscall.c uses int for calls that need one.
+			ret = syscall(tf->tf_regs.reg_eax, tf->tf_regs.reg_edx, tf->tf_regs.reg_ecx,
+										tf->tf_regs.reg_ebx, tf->tf_regs.reg_edi, 0);
+			tf->tf_regs.reg_eax = ret;
+			return;
 		default:
 			break;
 	}
@@ -290,6 +354,7 @@ trap_dispatch(struct Trapframe *tf)
 	if (tf->tf_trapno == IRQ_OFFSET + IRQ_SPURIOUS) {
 		cprintf("Spurious interrupt on irq 7\n");
 		print_trapframe(tf);
+		intr_account(tf, start);
 		return;
 	}
 
@@ -297,6 +362,16 @@ trap_dispatch(struct Trapframe *tf)
 	// interrupt using lapic_eoi() before calling the scheduler!
 	if (tf->tf_trapno == IRQ_OFFSET + IRQ_TIMER) {
 		lapic_eoi();
+		prof_tick(tf);
+		// Every CPU's LAPIC timer fires, but only one keeps time.
+		if (cpunum() == 0) {
+			time_tick();
+			futex_expire();
+			ipc_expire();
+		}
+		if (curenv)
+			curenv->env_vdso->vd_preempts++;
+		intr_account(tf, start);
 		sched_yield();
 		return; // yield doesn't return, but just in case...
 	}
@@ -304,11 +379,13 @@ trap_dispatch(struct Trapframe *tf)
 	// Handle keyboard and serial interrupts.
 	if (tf->tf_trapno == IRQ_OFFSET + IRQ_KBD) {
 		kbd_intr();
+		intr_account(tf, start);
 		return;
 	}
 
 	if (tf->tf_trapno == IRQ_OFFSET + IRQ_SERIAL) {
 		serial_intr();
+		intr_account(tf, start);
 		return;
 	}
 
@@ -357,12 +434,14 @@ trap(struct Trapframe *tf)
 			sched_yield();
 		}
 
-		// Copy trap frame (which is currently on the stack)
-		// into 'curenv->env_tf', so that running the environment
-		// will restart at the trap point.
-		curenv->env_tf = *tf;
-		// The trapframe on the stack should be ignored from here on.
-		tf = &curenv->env_tf;
+		// The entry code built the trap frame in 'curenv->env_tf'
+		// itself (see _alltraps), so running the environment will
+		// restart at the trap point.
+		assert(tf == &curenv->env_tf);
+
+		// Any trap is a chance to work through the environment's
+		// queued asynchronous system calls.
+		ring_run();
 	}
 
 	// Record that tf is the last real trapframe so
@@ -386,6 +465,8 @@ void
 page_fault_handler(struct Trapframe *tf)
 {
 	uint32_t fault_va;
+	uint64_t start = read_tsc();
+	struct EnvStats *stats;
 
 	// Read processor's CR2 register to find the faulting address
 	fault_va = rcr2();
@@ -397,6 +478,11 @@ page_fault_handler(struct Trapframe *tf)
 
 	// We've already handled kernel-mode exceptions, so if we get here,
 	// the page fault happened in user mode.
+	KTRACE(KT_PGFAULT, fault_va, tf->tf_eip, tf->tf_err);
+	stats = &curenv->env_vdso->vd_stats;
+	stats->es_pgfaults++;
+	if ((tf->tf_err & (FEC_PR|FEC_WR)) == (FEC_PR|FEC_WR))
+		stats->es_cowfaults++;
 
 	// Call the environment's page fault upcall, if one exists.  Set up a
 	// page fault stack frame on the user exception stack (below
@@ -449,6 +535,7 @@ page_fault_handler(struct Trapframe *tf)
 
 		tf->tf_esp = ux_stack_top;
 		tf->tf_eip = (uintptr_t)(curenv->env_pgfault_upcall);
+		stats->es_pgfault_cycles += read_tsc() - start;
 		env_run(curenv);
 	}
 
@@ -0,0 +1,165 @@
+// Shared-memory channels: a pair of lock-free single-producer,
+// single-consumer message rings between two environments.
+//
+// The environment that creates a channel sends on the first page and
+// receives on the second; the other end maps the same two pages (say,
+// passed along by IPC) and uses them the other way round.  Sending and
+// receiving are plain loads and stores on the shared pages.  The kernel
+// only gets involved when a consumer has run dry and gone to sleep:
+// the producer that moves its ring from empty to non-empty wakes it,
+// with sys_futex_wake or, for consumers that wait on several things at
+// once and so sleep in IPC receive, with sys_ipc_notify (see
+// chan_wake_by_ipc).  Neither ever blocks the producer.
+//
+// Head and tail count up forever; CHAN_NSLOTS is a power of two, so
+// they index the ring modulo CHAN_NSLOTS even across wraparound.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+// Keep the compiler from moving loads and stores across this point.
+// x86 doesn't reorder stores with other stores or loads with other
+// loads, so that's all one side needs to publish to the other.
+#define compiler_barrier()	__asm __volatile("" : : : "memory")
+
+// Create a new channel on two fresh pages at 'va' and 'va + PGSIZE',
+// mapped PTE_P|PTE_U|PTE_W plus 'perm': PTE_SHARE to hand the other end
+// to a child, or PTE_NOCOPY to keep it out of children altogether.
+// Returns 0 on success, < 0 on error.
+int
+chan_create(struct Chan *c, void *va, int perm)
+{
+	int r;
+
+	static_assert(sizeof(struct ChanRing) <= PGSIZE);
+
+	perm |= PTE_P|PTE_U|PTE_W;
+	if ((r = sys_page_alloc(0, va, perm)) < 0)
+		return r;
+	if ((r = sys_page_alloc(0, va + PGSIZE, perm)) < 0) {
+		sys_page_unmap(0, va);
+		return r;
+	}
+	c->ch_out = (struct ChanRing *) va;
+	c->ch_in = (struct ChanRing *) (va + PGSIZE);
+	c->ch_wakeenv = 0;
+	return 0;
+}
+
+// Set up 'c' as the other end of the channel whose pages are mapped at
+// 'va' and 'va + PGSIZE'.
+void
+chan_attach(struct Chan *c, void *va)
+{
+	c->ch_in = (struct ChanRing *) va;
+	c->ch_out = (struct ChanRing *) (va + PGSIZE);
+	c->ch_wakeenv = 0;
+}
+
+// Return the next free slot to fill in, or NULL if the ring is full.
+// The message is only sent once chan_send_end is called.
+struct ChanMsg *
+chan_send_begin(struct Chan *c)
+{
+	struct ChanRing *r = c->ch_out;
+
+	if (r->cr_tail - r->cr_head == CHAN_NSLOTS)
+		return NULL;
+	return &r->cr_msg[r->cr_tail % CHAN_NSLOTS];
+}
+
+// Send the message filled in since chan_send_begin, waking the consumer
+// if it went to sleep on an empty ring.
+void
+chan_send_end(struct Chan *c)
+{
+	struct ChanRing *r = c->ch_out;
+	uint32_t tail = r->cr_tail;
+
+	compiler_barrier();
+	r->cr_tail = tail + 1;
+
+	// A consumer only sleeps on an empty ring, so only the send that
+	// refills it needs to check.  The fence pairs with the xchg in
+	// chan_recv_wait and chan_arm: either the consumer sees the new
+	// tail, or we see its flag.
+	__sync_synchronize();
+	if (r->cr_head != tail || !xchg(&r->cr_waiting, 0))
+		return;
+	if (c->ch_wakeenv)
+		sys_ipc_notify(c->ch_wakeenv, c->ch_wakebits);
+	else
+		sys_futex_wake(&r->cr_tail, 1);
+}
+
+// Return the oldest message received, or NULL if there is none.
+// Its slot stays ours until chan_recv_end.
+struct ChanMsg *
+chan_recv_begin(struct Chan *c)
+{
+	struct ChanRing *r = c->ch_in;
+
+	if (r->cr_head == r->cr_tail)
+		return NULL;
+	compiler_barrier();
+	return &r->cr_msg[r->cr_head % CHAN_NSLOTS];
+}
+
+// Give the slot from chan_recv_begin back to the producer.
+void
+chan_recv_end(struct Chan *c)
+{
+	struct ChanRing *r = c->ch_in;
+
+	compiler_barrier();
+	r->cr_head = r->cr_head + 1;
+}
+
+// Sleep until there is a message to receive.
+void
+chan_recv_wait(struct Chan *c)
+{
+	struct ChanRing *r = c->ch_in;
+	uint32_t tail;
+
+	while ((tail = r->cr_tail) == r->cr_head) {
+		xchg(&r->cr_waiting, 1);
+		// The kernel re-checks the tail, so a send since we looked
+		// keeps us awake.
+		sys_futex_wait(&r->cr_tail, tail);
+	}
+}
+
+// For a peer that sleeps in IPC receive instead of chan_recv_wait
+// (because it serves several channels, or IPC as well): from now on,
+// wake the other end of 'c' by posting environment 'envid' the
+// notification bits 'bits' (see sys_ipc_notify) rather than with a futex.
+// Only the producer decides this, never anything on the shared pages:
+// that way the other end can't make us notify whoever it likes.
+void
+chan_wake_by_ipc(struct Chan *c, envid_t envid, uint32_t bits)
+{
+	c->ch_wakeenv = envid;
+	c->ch_wakebits = bits;
+}
+
+// Ask to be woken by IPC (see chan_wake_by_ipc) when the next
+// message arrives.  Call this on every channel before going to sleep in
+// IPC receive.  Returns 1 if a message is already waiting, in which case
+// the caller should not go to sleep after all.
+int
+chan_arm(struct Chan *c)
+{
+	struct ChanRing *r = c->ch_in;
+
+	xchg(&r->cr_waiting, 1);
+	return r->cr_head != r->cr_tail;
+}
+
+// Take back a chan_arm, once awake again, so that producers don't send
+// notifications nobody needs.
+void
+chan_disarm(struct Chan *c)
+{
+	c->ch_in->cr_waiting = 0;
+}
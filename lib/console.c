@@ -38,6 +38,7 @@ static ssize_t devcons_read(struct Fd*, void*, size_t);
 static ssize_t devcons_write(struct Fd*, const void*, size_t);
 static int devcons_close(struct Fd*);
 static int devcons_stat(struct Fd*, struct Stat*);
+static int devcons_poll(struct Fd*, int, struct FutexWait*);
 
 struct Dev devcons =
 {
@@ -46,9 +47,14 @@ struct Dev devcons =
 	.dev_read =	devcons_read,
 	.dev_write =	devcons_write,
 	.dev_close =	devcons_close,
-	.dev_stat =	devcons_stat
+	.dev_stat =	devcons_stat,
+	.dev_poll =	devcons_poll
 };
 
+// A character devcons_poll had to take from the kernel to find out
+// whether there was any input, or 0.
+static int cons_lookahead;
+
 int
 iscons(int fdnum)
 {
@@ -83,8 +89,11 @@ devcons_read(struct Fd *fd, void *vbuf, size_t n)
 	if (n == 0)
 		return 0;
 
-	while ((c = sys_cgetc()) == 0)
-		sys_yield();
+	if ((c = cons_lookahead) != 0)
+		cons_lookahead = 0;
+	else
+		while ((c = sys_cgetc()) == 0)
+			sys_yield();
 	if (c < 0)
 		return c;
 	if (c == 0x04)	// ctl-d is eof
@@ -126,3 +135,17 @@ devcons_stat(struct Fd *fd, struct Stat *stat)
 	return 0;
 }
 
+// The kernel has nothing to wait on for console input, so poll()
+// just checks back every so often.
+static int
+devcons_poll(struct Fd *fd, int events, struct FutexWait *w)
+{
+	int r = events & POLLOUT;
+
+	if ((events & POLLIN)
+	    && (cons_lookahead || (cons_lookahead = sys_cgetc()) != 0))
+		r |= POLLIN;
+	if (!r)
+		w->fw_addr = 0;
+	return r;
+}
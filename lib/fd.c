@@ -306,6 +306,63 @@ fstat(int fdnum, struct Stat *stat)
 	return (*dev->dev_stat)(fd, stat);
 }
 
+// Wait until at least one of the 'nfds' file descriptors in 'fds' is
+// ready for one of its pf_events, or until 'timeout' milliseconds pass
+// (forever if 'timeout' is negative; not at all if it is 0).
+// Sets pf_revents for every entry.  Closed descriptors report POLLNVAL.
+// While nothing is ready, we sleep in the kernel on the words the devices
+// hand back from dev_poll.
+//
+// Returns the number of entries with nonzero pf_revents (0 on timeout),
+// < 0 on error.  Errors are:
+//	-E_INVAL if nfds is negative or larger than FUTEX_NWAIT.
+int
+poll(struct PollFd *fds, int nfds, int timeout)
+{
+	struct FutexWait w[FUTEX_NWAIT];
+	struct Dev *dev;
+	struct Fd *fd;
+	unsigned deadline = sys_time_msec() + timeout;
+	int i, nw, nready, left;
+	bool recheck;
+
+	if (nfds < 0 || nfds > FUTEX_NWAIT)
+		return -E_INVAL;
+
+	while (1) {
+		nready = nw = recheck = 0;
+		for (i = 0; i < nfds; i++) {
+			if (fd_lookup(fds[i].pf_fd, &fd) < 0
+			    || dev_lookup(fd->fd_dev_id, &dev) < 0)
+				fds[i].pf_revents = POLLNVAL;
+			else if (!dev->dev_poll)
+				fds[i].pf_revents = fds[i].pf_events & (POLLIN|POLLOUT);
+			else if (!(fds[i].pf_revents = (*dev->dev_poll)(fd, fds[i].pf_events, &w[nw]))) {
+				if (w[nw].fw_addr)
+					nw++;
+				else
+					recheck = 1;
+			}
+			if (fds[i].pf_revents)
+				nready++;
+		}
+		if (nready || timeout == 0)
+			return nready;
+
+		left = -1;
+		if (timeout > 0 && (left = deadline - sys_time_msec()) <= 0)
+			return 0;
+		// Devices that can't tell us what to wait for get looked at
+		// again every clock tick or so.
+		if (recheck && (left < 0 || left > 10))
+			left = 10;
+		if (debug)
+			cprintf("[%08x] poll sleep %d words %d ms\n",
+				thisenv->env_id, nw, left);
+		sys_futex_waitv(w, nw, left);
+	}
+}
+
 int
 stat(const char *path, struct Stat *stat)
 {
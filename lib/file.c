@@ -6,6 +6,24 @@
 
 union Fsipc fsipcbuf __attribute__((aligned(PGSIZE)));
 
+// Where the pages of large read replies get mapped: just below the
+// file descriptor table (see fd.c).
+#define FSREADVA	(0xD0000000 - IPC_MAXPAGES * PGSIZE)
+// Where this environment's channel to the file server lives.
+#define FSCHANVA	(FSREADVA - 2 * PGSIZE)
+
+// Find the file server, which registers itself as "fs" once it is up;
+// if it hasn't yet, wait for it.
+static envid_t
+fs_lookup(void)
+{
+	envid_t fsenv;
+
+	while ((fsenv = ipc_lookup("fs")) == 0)
+		sys_yield();
+	return fsenv;
+}
+
 // Send an inter-environment request to the file server, and wait for
 // a reply.  The request body should be in fsipcbuf, and parts of the
 // response may be written back to fsipcbuf.
@@ -15,17 +33,127 @@ union Fsipc fsipcbuf __attribute__((aligned(PGSIZE)));
 static int
 fsipc(unsigned type, void *dstva)
 {
-	static envid_t fsenv;
-	if (fsenv == 0)
-		fsenv = ipc_find_env(ENV_TYPE_FS);
-
 	static_assert(sizeof(fsipcbuf) == PGSIZE);
 
 	if (debug)
 		cprintf("[%08x] fsipc %d %08x\n", thisenv->env_id, type, *(uint32_t *)&fsipcbuf);
 
-	ipc_send(fsenv, type, &fsipcbuf, PTE_P | PTE_W | PTE_U);
-	return ipc_recv(NULL, dstva, NULL);
+	return ipc_call(fs_lookup(), type, &fsipcbuf, PTE_P | PTE_W | PTE_U,
+			dstva, NULL);
+}
+
+// Like fsipc, for small requests: send only the first 'len' bytes of
+// fsipcbuf as message payload, with no page, and copy the reply's
+// payload back into fsipcbuf.  This saves mapping the page into the
+// server and unmapping it again.
+// Up to 'npages' pages of the reply are mapped at 'dstva' (if nonnull).
+static int
+fsipc_short(unsigned type, size_t len, void *dstva, int npages)
+{
+	static struct IpcMsg msg;
+	int r;
+
+	assert(len <= sizeof(msg.im_words));
+	msg.im_value = type;
+	msg.im_srcva = (void *) UTOP;
+	msg.im_perm = 0;
+	msg.im_npages = 0;
+	msg.im_nwords = ROUNDUP(len, sizeof(uint32_t)) / sizeof(uint32_t);
+	memmove(msg.im_words, &fsipcbuf, len);
+
+	r = ipc_callmsg(fs_lookup(), &msg, dstva, npages, NULL, -1);
+	memmove(&fsipcbuf, (void *) thisenv->env_ipc_msg,
+		thisenv->env_ipc_msglen * sizeof(uint32_t));
+	return r;
+}
+
+// Small requests can also go over a channel (see chan.c), which only
+// costs a system call when one side has to wake the other, and lets
+// us queue several requests before waiting for any reply.  We never
+// have more than CHAN_NSLOTS requests outstanding, so neither ring can
+// fill up.
+static struct Chan fschan;
+static envid_t fschan_env;	// Environment that set up fschan
+static bool fschan_ok;		// Whether it managed to
+
+// Return this environment's channel to the file server, setting it up
+// on first use, or NULL if there is none.  Each ring has one producer,
+// so the pages are PTE_NOCOPY: a child doesn't get its parent's channel
+// and sets up one of its own.
+static struct Chan *
+fschan_get(void)
+{
+	static struct IpcMsg msg;
+
+	if (fschan_env == thisenv->env_id)
+		return fschan_ok ? &fschan : NULL;
+
+	fschan_env = thisenv->env_id;
+	fschan_ok = 0;
+	if (chan_create(&fschan, (void *) FSCHANVA, PTE_NOCOPY) < 0)
+		return NULL;
+
+	msg.im_value = FSREQ_CHANNEL;
+	msg.im_srcva = (void *) FSCHANVA;
+	msg.im_perm = PTE_P|PTE_U|PTE_W;
+	msg.im_npages = 2;
+	msg.im_nwords = 0;
+	if (ipc_callmsg(fs_lookup(), &msg, NULL, 0, NULL, -1) < 0) {
+		sys_page_unmap(0, (void *) FSCHANVA);
+		sys_page_unmap(0, (void *) FSCHANVA + PGSIZE);
+		return NULL;
+	}
+	// The server sleeps in IPC receive, so wake it that way.
+	chan_wake_by_ipc(&fschan, fs_lookup(), FSNOTIFY_CHAN);
+	fschan_ok = 1;
+	return &fschan;
+}
+
+// Queue request 'type', with the first 'len' bytes of fsipcbuf as its
+// arguments, on channel 'c'.
+static void
+fschan_send(struct Chan *c, unsigned type, size_t len)
+{
+	struct ChanMsg *m;
+
+	if (debug)
+		cprintf("[%08x] fschan %d %08x\n", thisenv->env_id, type, *(uint32_t *)&fsipcbuf);
+
+	m = chan_send_begin(c);
+	assert(m && len <= CHAN_MSGDATA);
+	m->cm_value = type;
+	m->cm_len = len;
+	memmove(m->cm_data, &fsipcbuf, len);
+	chan_send_end(c);
+}
+
+// Wait for the reply to the oldest request queued on 'c', copy at most
+// 'n' bytes of its data to 'buf', and return the server's result.
+static int
+fschan_recv(struct Chan *c, void *buf, size_t n)
+{
+	struct ChanMsg *m;
+	int r;
+
+	chan_recv_wait(c);
+	m = chan_recv_begin(c);
+	r = m->cm_value;
+	memmove(buf, m->cm_data, MIN(n, m->cm_len));
+	chan_recv_end(c);
+	return r;
+}
+
+// Like fsipc_short without pages: over the channel if we have one,
+// by IPC if not.
+static int
+fsipc_chan(unsigned type, size_t len)
+{
+	struct Chan *c;
+
+	if (!(c = fschan_get()))
+		return fsipc_short(type, len, NULL, 0);
+	fschan_send(c, type, len);
+	return fschan_recv(c, &fsipcbuf, sizeof(fsipcbuf));
 }
 
 static int devfile_flush(struct Fd *fd);
@@ -98,7 +226,7 @@ static int
 devfile_flush(struct Fd *fd)
 {
 	fsipcbuf.flush.req_fileid = fd->fd_file.id;
-	return fsipc(FSREQ_FLUSH, NULL);
+	return fsipc_chan(FSREQ_FLUSH, sizeof(fsipcbuf.flush));
 }
 
 // Read at most 'n' bytes from 'fd' at the current position into 'buf'.
@@ -110,18 +238,46 @@ static ssize_t
 devfile_read(struct Fd *fd, void *buf, size_t n)
 {
 	// Make an FSREQ_READ request to the file system server after
-	// filling fsipcbuf.read with the request arguments.  The
-	// bytes read will be written back to fsipcbuf by the file
-	// system server.
-	int r;
+	// filling fsipcbuf.read with the request arguments.  Small
+	// reads come back in the reply message, in fsipcbuf; bigger
+	// ones come as a run of pages mapped at FSREADVA.
+	void *src = &fsipcbuf;
+	struct Chan *c;
+	size_t off, total;
+	int r, err;
 
 	fsipcbuf.read.req_fileid = fd->fd_file.id;
-	fsipcbuf.read.req_n = n;
-	if ((r = fsipc(FSREQ_READ, NULL)) < 0)
+	if (n <= CHAN_NSLOTS * CHAN_MSGDATA && (c = fschan_get())) {
+		// Send one request per message's worth of data, all of them
+		// before waiting for the first reply.  The server serves them
+		// in order, so the replies come back in file order; after a
+		// short one (end of file) the rest are empty.
+		for (off = 0; off < n; off += CHAN_MSGDATA) {
+			fsipcbuf.read.req_n = MIN(n - off, CHAN_MSGDATA);
+			fschan_send(c, FSREQ_READ, sizeof(fsipcbuf.read));
+		}
+		for (total = err = 0, off = 0; off < n; off += CHAN_MSGDATA) {
+			r = fschan_recv(c, buf + total, n - total);
+			if (r < 0 && !err)
+				err = r;
+			else if (r > 0 && !err)
+				total += r;
+		}
+		return total ? total : err;
+	} else if (n <= IPC_MSGWORDS * sizeof(uint32_t)) {
+		fsipcbuf.read.req_n = n;
+		r = fsipc_short(FSREQ_READ, sizeof(fsipcbuf.read), NULL, 0);
+	} else {
+		n = MIN(n, IPC_MAXPAGES * PGSIZE);
+		fsipcbuf.read.req_n = n;
+		src = (void *) FSREADVA;
+		r = fsipc_short(FSREQ_READ, sizeof(fsipcbuf.read), src,
+				ROUNDUP(n, PGSIZE) / PGSIZE);
+	}
+	if (r < 0)
 		return r;
 	assert(r <= n);
-	assert(r <= PGSIZE);
-	memmove(buf, &fsipcbuf, r);
+	memmove(buf, src, r);
 	return r;
 }
 
@@ -132,7 +288,7 @@ devfile_stat(struct Fd *fd, struct Stat *st)
 	int r;
 
 	fsipcbuf.stat.req_fileid = fd->fd_file.id;
-	if ((r = fsipc(FSREQ_STAT, NULL)) < 0)
+	if ((r = fsipc_chan(FSREQ_STAT, sizeof(fsipcbuf.stat))) < 0)
 		return r;
 	strcpy(st->st_name, fsipcbuf.statRet.ret_name);
 	st->st_size = fsipcbuf.statRet.ret_size;
@@ -4,10 +4,6 @@
 #include <inc/string.h>
 #include <inc/lib.h>
 
-// PTE_COW marks copy-on-write page table entries.
-// It is one of the bits explicitly allocated to user processes (PTE_AVAIL).
-#define PTE_COW		0x800
-
 //
 // Custom page fault handler - if faulting page is copy-on-write,
 // map in our own private writable copy.
@@ -125,7 +121,7 @@ fork(void)
 
 	if (envid == 0) {
 		// Remember to fix "thisenv" in the child process.
-		thisenv = &envs[ENVX(sys_getenvid())];
+		thisenv = &envs[ENVX(getenvid())];
 		return 0;
 	}
 
@@ -135,9 +131,10 @@ fork(void)
 		panic("sys_page_alloc failed with: %e", r);
 	}
 
-	// In the parent.  Dupe pages, starting one page after UTOP (because we
-	// already fixed up UXSTACKTOP above) and work downward.
-	int page_num = PGNUM(UTOP) - 2;
+	// In the parent.  Dupe pages, starting at the top of the normal stack
+	// (we already fixed up UXSTACKTOP above, and the child has its own
+	// UVDSO page) and work downward.
+	int page_num = PGNUM(USTACKTOP) - 1;
 	do {
 		uint32_t dir_num = page_num >> (PDXSHIFT - PTXSHIFT);
 		if (!(uvpd[dir_num] & PTE_P)) {
@@ -146,7 +143,7 @@ fork(void)
 			page_num = (dir_num << (PDXSHIFT - PTXSHIFT)) - 1;
 		}
 		else {
-			if (uvpt[page_num] & PTE_P) {
+			if ((uvpt[page_num] & (PTE_P|PTE_NOCOPY)) == PTE_P) {
 				// This page is present, should dupe it.
 				duppage(envid, page_num);
 			}
@@ -165,6 +162,34 @@ fork(void)
 	return envid;
 }
 
+extern void (*_pgfault_handler)(struct UTrapframe *utf);
+
+// Whether this environment could resolve writes to copy-on-write pages:
+// it has fork's page fault handler, or no handler at all yet.  Anything
+// that hands out PTE_COW mappings outside of fork (like pipes passing
+// whole pages) must check this first, then call cow_ready once it
+// actually has such pages.
+//
+// Returns 1 if COW mappings would be safe, 0 if some other handler owns
+// faults.
+int
+cow_ok(void)
+{
+	return !_pgfault_handler || _pgfault_handler == pgfault;
+}
+
+// Make sure a write to a copy-on-write page in this environment gets
+// resolved, installing fork's page fault handler if no handler is set.
+//
+// Returns 1 if COW mappings are safe, 0 if some other handler owns faults.
+int
+cow_ready(void)
+{
+	if (!_pgfault_handler)
+		set_pgfault_handler(pgfault);
+	return _pgfault_handler == pgfault;
+}
+
 // Challenge!
 int
 sfork(void)
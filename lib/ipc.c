@@ -8,17 +8,29 @@
 // If the system call fails, then store 0 in *fromenv and *perm (if
 //	they're nonnull) and return the error.
 // Otherwise, return the value sent by the sender
+// A sender of 0 means the message is the notification bits posted by
+// sys_ipc_notify since we last received.
 //
 // Hint:
 //   Use 'thisenv' to discover the value and who sent it.
 int32_t
 ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
+{
+	return ipc_recv_timeout(from_env_store, pg, perm_store, -1);
+}
+
+// Like ipc_recv, but give up after 'timeout' milliseconds, returning
+// -E_TIMEOUT.  A timeout of 0 only takes a message that is already
+// waiting; a negative one waits forever.
+int32_t
+ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+		 int timeout)
 {
 	// If 'pg' is null, pass sys_ipc_recv a value that it will understand
 	// as meaning "no page".  (Zero is not the right value, since that's
 	// a perfectly valid place to map a page.)
 	void* dstva = (pg != NULL) ? pg : (void *)UTOP;
-	int success = sys_ipc_recv(dstva);
+	int success = sys_ipc_recv(dstva, timeout);
 
 	// If 'from_env_store' is nonnull, then store the IPC sender's envid in
 	//  *from_env_store.
@@ -42,32 +54,90 @@ ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
 }
 
 // Send 'val' (and 'pg' with 'perm', if 'pg' is nonnull) to 'toenv'.
-// This function keeps trying until it succeeds.
-// It should panic() on any error other than -E_IPC_NOT_RECV.
-//
-// Hint:
+// This blocks in the kernel until 'toenv' receives the message;
+// senders are served in the order they started waiting.
+// Panics on any error.
 void
 ipc_send(envid_t to_env, uint32_t val, void *pg, int perm)
 {
-	// If 'pg' is null, pass sys_ipc_recv a value that it will understand
+	// If 'pg' is null, pass sys_ipc_send a value that it will understand
 	// as meaning "no page".  (Zero is not the right value.)
 	void* srcva = (pg != NULL) ? pg : (void *)UTOP;
 
-	while (true) {
-		int success = sys_ipc_try_send(to_env, val, srcva, perm);
-		if (success == -E_IPC_NOT_RECV) {
-			// Use sys_yield() to be CPU-friendly.
-			sys_yield();
-		} else if (success < 0) {
-			panic("sys_ipc_try_send failed with: %e\n", success);
-		} else {
-			return;
-		}
+	int success = sys_ipc_send(to_env, val, srcva, perm);
+	if (success < 0) {
+		panic("sys_ipc_send failed with: %e\n", success);
+	}
+}
+
+// Send the request 'msg' (see inc/ipc.h) to 'to_env' and wait for its
+// reply, which is received as by ipc_recv(NULL, rcv_pg, perm_store),
+// except that up to 'rcv_npages' pages of it are mapped from 'rcv_pg' on.
+// Any payload words in the reply are in thisenv->env_ipc_msg, and the
+// number of pages received is thisenv->env_ipc_npages.
+// Nobody but 'to_env' can answer.  If no answer comes within 'timeout'
+// milliseconds (unless it is negative), the call fails with -E_TIMEOUT.
+// Returns the reply's value, or < 0 if the call itself fails (with 0
+// stored in *perm_store).
+int32_t
+ipc_callmsg(envid_t to_env, const struct IpcMsg *msg,
+	    void *rcv_pg, int rcv_npages, int *perm_store, int timeout)
+{
+	void* dstva = (rcv_pg != NULL) ? rcv_pg : (void *)UTOP;
+	int success = sys_ipc_call(to_env, msg, dstva, rcv_npages, timeout);
+
+	if (perm_store != NULL) {
+		*perm_store = (success == 0) ? thisenv->env_ipc_perm : 0;
+	}
+	return (success == 0) ? thisenv->env_ipc_value : success;
+}
+
+// Like ipc_callmsg, for a request that is just 'val' and, if 'pg' is
+// nonnull, the page 'pg' with 'perm'.
+int32_t
+ipc_call(envid_t to_env, uint32_t val, void *pg, int perm,
+	 void *rcv_pg, int *perm_store)
+{
+	struct IpcMsg msg;
+
+	msg.im_value = val;
+	msg.im_srcva = (pg != NULL) ? pg : (void *)UTOP;
+	msg.im_perm = perm;
+	msg.im_npages = 1;
+	msg.im_nwords = 0;
+	return ipc_callmsg(to_env, &msg, rcv_pg, 1, perm_store, -1);
+}
+
+// Server loop helper: reply to the ipc_call of 'to_env' with 'msg', then
+// receive the next request as ipc_recv_timeout(from_env_store, rcv_pg,
+// perm_store, timeout) does, except that up to 'rcv_npages' pages of it
+// are mapped from 'rcv_pg' on; its payload words are in
+// thisenv->env_ipc_msg.
+// Pass 'to_env' 0 to skip the reply, e.g. on the first trip around the
+// loop.  Replies to callers that have gone away are silently dropped, and
+// so are replies to requests that didn't come from ipc_call (with
+// thisenv->env_ipc_fromcall clear): answer those with ipc_send.
+int32_t
+ipc_reply_wait(envid_t to_env, const struct IpcMsg *msg,
+	       envid_t *from_env_store, void *rcv_pg, int rcv_npages,
+	       int *perm_store, int timeout)
+{
+	void* dstva = (rcv_pg != NULL) ? rcv_pg : (void *)UTOP;
+	int success = sys_ipc_reply_wait(to_env, msg, dstva, rcv_npages,
+					 timeout);
+
+	if (from_env_store != NULL) {
+		*from_env_store = (success == 0) ? thisenv->env_ipc_from : 0;
 	}
+	if (perm_store != NULL) {
+		*perm_store = (success == 0) ? thisenv->env_ipc_perm : 0;
+	}
+	return (success == 0) ? thisenv->env_ipc_value : success;
 }
 
 // Find the first environment of the given type.  We'll use this to
-// find special environments.
+// find special environments.  (Servers are better found by name with
+// ipc_lookup, which doesn't scan all of envs[].)
 // Returns 0 if no such environment exists.
 envid_t
 ipc_find_env(enum EnvType type)
@@ -78,3 +148,41 @@ ipc_find_env(enum EnvType type)
 			return envs[i].env_id;
 	return 0;
 }
+
+#define NLOOKUPCACHE	8
+
+// Find the server registered (with sys_service_register) as 'name'.
+// Answers are cached, so repeated lookups don't enter the kernel as
+// long as the server we found is still running.
+// Returns 0 if no environment has the name.
+envid_t
+ipc_lookup(const char *name)
+{
+	static struct {
+		char name[SERVICE_NAMELEN];
+		envid_t env;
+	} cache[NLOOKUPCACHE];
+	const volatile struct Env *e;
+	uint32_t h = 0;
+	const char *s;
+	envid_t env;
+	int i;
+
+	for (s = name; *s; s++)
+		h = h * 31 + (uint8_t) *s;
+	i = h % NLOOKUPCACHE;
+
+	if (cache[i].env && strcmp(cache[i].name, name) == 0) {
+		e = &envs[ENVX(cache[i].env)];
+		if (e->env_id == cache[i].env && e->env_status != ENV_FREE)
+			return cache[i].env;
+	}
+
+	// The kernel only finds names short enough to cache.
+	if ((env = sys_service_lookup(name)) < 0)
+		return 0;
+	strcpy(cache[i].name, name);
+	cache[i].env = env;
+	return env;
+}
+
@@ -1,5 +1,5 @@
 // Called from entry.S to get us going.
-// entry.S already took care of defining envs, pages, uvpd, and uvpt.
+// entry.S already took care of defining envs, pages, vdso, uvpd, and uvpt.
 
 #include <inc/lib.h>
 
@@ -12,7 +12,7 @@ void
 libmain(int argc, char **argv)
 {
 	// set thisenv to point at our Env structure in envs[].
-	envid_t envid = sys_getenvid();
+	envid_t envid = getenvid();
 	thisenv = &(envs[ENVX(envid)]);
 
 	// save the name of the program so that panic() can use it
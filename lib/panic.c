@@ -15,7 +15,7 @@ _panic(const char *file, int line, const char *fmt, ...)
 
 	// Print the panic message
 	cprintf("[%08x] user panic in %s at %s:%d: ",
-		sys_getenvid(), binaryname, file, line);
+		getenvid(), binaryname, file, line);
 	vcprintf(fmt, ap);
 	cprintf("\n");
 
@@ -1,3 +1,4 @@
+#include <inc/x86.h>
 #include <inc/lib.h>
 
 #define debug 0
@@ -6,6 +7,7 @@ static ssize_t devpipe_read(struct Fd *fd, void *buf, size_t n);
 static ssize_t devpipe_write(struct Fd *fd, const void *buf, size_t n);
 static int devpipe_stat(struct Fd *fd, struct Stat *stat);
 static int devpipe_close(struct Fd *fd);
+static int devpipe_poll(struct Fd *fd, int events, struct FutexWait *w);
 
 struct Dev devpipe =
 {
@@ -15,16 +17,64 @@ struct Dev devpipe =
 	.dev_write =	devpipe_write,
 	.dev_close =	devpipe_close,
 	.dev_stat =	devpipe_stat,
+	.dev_poll =	devpipe_poll,
 };
 
-#define PIPEBUFSIZ 32		// small to provoke races
+// The ring fills the rest of the shared data page.  Build with
+// DEFS=-DPIPE_SMALLBUF to get a 32-byte ring instead, which is
+// small enough to provoke the full/empty races the tests look for.
+#define PIPEHDRSIZ	44
+#ifdef PIPE_SMALLBUF
+#define PIPEBUFSIZ	32
+#else
+#define PIPEBUFSIZ	(PGSIZE - PIPEHDRSIZ)
+#endif
 
 struct Pipe {
-	off_t p_rpos;		// read position
-	off_t p_wpos;		// write position
+	volatile off_t p_rpos;	// read position
+	volatile off_t p_wpos;	// write position
+	uint32_t p_rwaiting;	// a reader may be asleep on p_wpos
+	uint32_t p_wwaiting;	// a writer may be asleep on p_rpos
+	// whole-page handoff; see pipe_flip_recv
+	volatile envid_t p_flipenv;	// reader that owns the request, or 0
+	volatile envid_t p_flipclaim;	// FLIP_OPEN, answering writer, or 0
+	volatile uintptr_t p_flipva;	// where it wants them
+	volatile size_t p_flipmax;	// how many pages it will take
+	volatile size_t p_flipped;	// how many pages it got
+	volatile off_t p_flipseq;	// bumped each time a request is answered
+	uint32_t p_fwaiting;	// a reader may be asleep on p_flipseq
 	uint8_t p_buf[PIPEBUFSIZ];	// data buffer
 };
 
+// p_flipclaim while a request is posted and any writer may take it.
+// A writer answering it swaps in its own envid, and the answer (or the
+// reader withdrawing the request) sets it back to 0.
+#define FLIP_OPEN	((envid_t) -1)
+
+// Positions run from 0 to 2*PIPEBUFSIZ-1 and wrap there, so a full ring
+// can be told apart from an empty one even though PIPEBUFSIZ is not a
+// power of two.  The buffer index of a position is pos mod PIPEBUFSIZ.
+static size_t
+pipe_count(struct Pipe *p)
+{
+	return (p->p_wpos - p->p_rpos + 2 * PIPEBUFSIZ) % (2 * PIPEBUFSIZ);
+}
+
+static off_t
+pipe_advance(off_t pos, size_t n)
+{
+	pos += n;
+	if (pos >= 2 * PIPEBUFSIZ)
+		pos -= 2 * PIPEBUFSIZ;
+	return pos;
+}
+
+static size_t
+pipe_index(off_t pos)
+{
+	return pos < PIPEBUFSIZ ? pos : pos - PIPEBUFSIZ;
+}
+
 int
 pipe(int pfd[2])
 {
@@ -32,6 +82,9 @@ pipe(int pfd[2])
 	struct Fd *fd0, *fd1;
 	void *va;
 
+	static_assert(offsetof(struct Pipe, p_buf) == PIPEHDRSIZ);
+	static_assert(sizeof(struct Pipe) <= PGSIZE);
+
 	// allocate the file descriptor table entries
 	if ((r = fd_alloc(&fd0)) < 0
 	    || (r = sys_page_alloc(0, fd0, PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
@@ -101,47 +154,285 @@ pipeisclosed(int fdnum)
 	return _pipeisclosed(fd, p);
 }
 
+// Sleep in the kernel until '*pos' moves on from 'seen', the value the
+// caller based its decision to wait on, or until the other end of the
+// pipe is closed.
+// 'waiting' is the flag the other end checks to decide whether it
+// needs to wake us after moving '*pos'.
+// Returns 1 if the pipe is closed, 0 if the caller should look again.
+static int
+pipe_block(struct Fd *fd, struct Pipe *p, volatile off_t *pos, off_t seen,
+	   volatile uint32_t *waiting)
+{
+	int refs = pageref(p);
+
+	if (_pipeisclosed(fd, p))
+		return 1;
+
+	// Announce ourselves before the kernel re-checks 'pos'.  xchg is a
+	// full barrier, so the other end either sees the flag or we see
+	// its update.  If a peer unmaps the pipe after we sampled 'refs',
+	// the kernel notices the changed reference count and won't let
+	// us sleep; if it happens later, the unmap wakes us.
+	xchg(waiting, 1);
+	if (debug)
+		cprintf("[%08x] pipe sleep\n", thisenv->env_id);
+	sys_futex_wait_pageref((volatile uint32_t *) pos, seen, refs);
+	return 0;
+}
+
+// Wake the other end if it is asleep waiting for '*pos' to move.
+static void
+pipe_wakeup(volatile off_t *pos, volatile uint32_t *waiting)
+{
+	if (xchg(waiting, 0))
+		sys_futex_wake((volatile uint32_t *) pos, NENV);
+}
+
+// Can the 'npages' pages at 'va' be handed over copy-on-write?
+// Pages we share with someone else on purpose must stay shared, and
+// with 'source' set the pages must also exist and be writable (so that
+// the COW fault handler will know what to do with them), and be mapped
+// nowhere else, or sys_page_flip won't hand them over.  We must also be
+// able to take COW faults, but fork's fault handler is only installed
+// once pages actually change hands (see cow_ready), so that merely
+// reading a pipe doesn't take over page faults.
+static bool
+pipe_flippable(const void *va, size_t npages, bool source)
+{
+	uintptr_t a;
+	pte_t pte;
+
+	for (a = (uintptr_t) va; npages-- > 0; a += PGSIZE) {
+		pte = (uvpd[PDX(a)] & PTE_P) ? uvpt[PGNUM(a)] : 0;
+		if (pte & PTE_SHARE)
+			return 0;
+		if (source && !((pte & PTE_P) && (pte & (PTE_W|PTE_COW))
+				 && pageref((void *) a) == 1))
+			return 0;
+	}
+	return cow_ok();
+}
+
+// Whether environment 'id' has exited.
+static bool
+pipe_env_gone(envid_t id)
+{
+	const volatile struct Env *e = &envs[ENVX(id)];
+
+	return e->env_id != id || e->env_status == ENV_FREE;
+}
+
+// Clear out a request for whole pages whose reader exited without
+// withdrawing it, so that the next reader can post one.  Leave it be
+// while a live writer is still answering it.
+static void
+pipe_flip_reap(struct Pipe *p)
+{
+	envid_t e = p->p_flipenv, c = p->p_flipclaim;
+
+	if (e == 0 || !pipe_env_gone(e))
+		return;
+	if (c != 0 && c != FLIP_OPEN && !pipe_env_gone(c))
+		return;
+	if (cmpxchg((volatile uint32_t *) &p->p_flipclaim, c, 0) == c)
+		cmpxchg((volatile uint32_t *) &p->p_flipenv, e, 0);
+}
+
+// Answer the request the caller claimed, saying we delivered 'npages'
+// pages, and wake its reader.
+static void
+pipe_flip_answer(struct Pipe *p, size_t npages)
+{
+	p->p_flipped = npages;
+	xchg((volatile uint32_t *) &p->p_flipclaim, 0);
+	__sync_fetch_and_add(&p->p_flipseq, 1);
+	pipe_wakeup(&p->p_flipseq, &p->p_fwaiting);
+}
+
+// Wake readers after adding bytes to the ring.  A reader asking for whole
+// pages only watches p_flipseq, so turn its request down; it will find
+// the bytes in the ring instead.
+static void
+pipe_wake_readers(struct Pipe *p)
+{
+	if (p->p_flipclaim == FLIP_OPEN
+	    && cmpxchg((volatile uint32_t *) &p->p_flipclaim, FLIP_OPEN,
+		       thisenv->env_id) == FLIP_OPEN)
+		pipe_flip_answer(p, 0);
+	pipe_wakeup(&p->p_wpos, &p->p_rwaiting);
+}
+
+// Reader side of the zero-copy path.  With the ring empty and a
+// page-aligned buffer of at least a page, ask the writer to hand its
+// pages straight to 'buf' (copy-on-write on both sides) rather than
+// copying bytes through the ring, and wait for the answer.  The kernel
+// only lets environments that share this pipe's data page do that.
+// Any bytes written to the ring meanwhile end the request, so the data
+// stays in order.
+// Returns the number of bytes received this way, 0 if the caller should
+// fall back to the ring (which is also how closure gets noticed).
+static ssize_t
+pipe_flip_recv(struct Fd *fd, struct Pipe *p, void *buf, size_t npages)
+{
+	envid_t me = thisenv->env_id, c;
+	off_t seq;
+	bool closed = 0;
+	size_t got;
+
+	if (!pipe_flippable(buf, npages, 0))
+		return 0;
+	// Only one reader may have a request outstanding.
+	if (cmpxchg((volatile uint32_t *) &p->p_flipenv, 0, me) != 0) {
+		pipe_flip_reap(p);
+		return 0;
+	}
+	if (sys_page_accept(buf, npages * PGSIZE, p) < 0) {
+		p->p_flipenv = 0;
+		return 0;
+	}
+	p->p_flipva = (uintptr_t) buf;
+	p->p_flipmax = npages;
+	p->p_flipped = 0;
+	// Post the request; xchg orders it before our look at the ring.
+	xchg((volatile uint32_t *) &p->p_flipclaim, FLIP_OPEN);
+
+	while (1) {
+		seq = p->p_flipseq;
+		c = p->p_flipclaim;
+		if (c == 0) {
+			// answered
+			got = p->p_flipped;
+			break;
+		}
+		got = 0;
+		if (c == FLIP_OPEN) {
+			// Withdraw the request if we have bytes or eof
+			// to return instead.
+			if ((closed || pipe_count(p) != 0)
+			    && cmpxchg((volatile uint32_t *) &p->p_flipclaim,
+				       FLIP_OPEN, 0) == FLIP_OPEN)
+				break;
+		} else if (pipe_env_gone(c)) {
+			// The writer answering us died (its unmapping the
+			// pipe woke us).  Take back the request; whatever
+			// pages it got through are ignored.
+			if (cmpxchg((volatile uint32_t *) &p->p_flipclaim,
+				    c, 0) == c)
+				break;
+		}
+		closed = pipe_block(fd, p, &p->p_flipseq, seq, &p->p_fwaiting);
+	}
+
+	sys_page_accept(0, 0, 0);
+	p->p_flipenv = 0;
+	// The pages came in copy-on-write.
+	if (got)
+		cow_ready();
+	if (debug && got)
+		cprintf("[%08x] pipe got %d pages\n", me, got);
+	return got * PGSIZE;
+}
+
+// Writer side of the zero-copy path: if a reader is waiting for whole
+// pages and nothing is queued ahead of us in the ring, hand it up to
+// 'npages' pages from 'buf'.
+// Returns the number of bytes handed over, 0 if the caller should use
+// the ring.
+static ssize_t
+pipe_flip_send(struct Pipe *p, const void *buf, size_t npages)
+{
+	envid_t e;
+	uintptr_t src, dst;
+	size_t i;
+	int perm = PTE_P|PTE_U|PTE_COW;
+
+	if (p->p_flipenv == 0)
+		return 0;
+	if (p->p_flipclaim != FLIP_OPEN || pipe_count(p) != 0
+	    || !pipe_flippable(buf, npages, 1)) {
+		pipe_flip_reap(p);
+		return 0;
+	}
+	if (cmpxchg((volatile uint32_t *) &p->p_flipclaim, FLIP_OPEN,
+		    thisenv->env_id) != FLIP_OPEN)
+		return 0;
+
+	// The request can't change hands while we hold it.
+	// Someone may have used the ring since we looked.
+	e = p->p_flipenv;
+	npages = pipe_count(p) == 0 ? MIN(npages, p->p_flipmax) : 0;
+	src = (uintptr_t) buf;
+	dst = p->p_flipva;
+	// Our pages are about to become copy-on-write.
+	if (npages)
+		cow_ready();
+	for (i = 0; i < npages; i++, src += PGSIZE, dst += PGSIZE) {
+		// Like fork's duppage: the reader's mapping and ours both
+		// become copy-on-write, so neither side sees later writes
+		// by the other.
+		if (sys_page_flip((void *) src, e, (void *) dst, p, perm) < 0)
+			break;
+	}
+	pipe_flip_answer(p, i);
+	return i * PGSIZE;
+}
+
 static ssize_t
 devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 {
 	uint8_t *buf;
-	size_t i;
+	size_t i, m, avail, idx;
 	struct Pipe *p;
+	ssize_t r;
+	off_t seen;
 
 	p = (struct Pipe*)fd2data(fd);
 	if (debug)
 		cprintf("[%08x] devpipe_read %08x %d rpos %d wpos %d\n",
 			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
 
+	if (n == 0)
+		return 0;
+
+	// an empty pipe and a page-aligned buffer:
+	// try to take whole pages without copying them
+	if (pipe_count(p) == 0 && PGOFF(vbuf) == 0 && n >= PGSIZE
+	    && (r = pipe_flip_recv(fd, p, vbuf, n / PGSIZE)) > 0)
+		return r;
+
+	while ((seen = p->p_wpos) == p->p_rpos) {
+		// pipe is empty
+		// sleep until a writer adds data,
+		// or note eof if all the writers are gone
+		if (pipe_block(fd, p, &p->p_wpos, seen, &p->p_rwaiting))
+			return 0;
+	}
+
+	// take whatever is there, in at most two contiguous runs
+	// (the second one after the ring wraps around).
+	// wait to advance rpos until the bytes are taken!
+	avail = pipe_count(p);
+	n = MIN(n, avail);
 	buf = vbuf;
-	for (i = 0; i < n; i++) {
-		while (p->p_rpos == p->p_wpos) {
-			// pipe is empty
-			// if we got any data, return it
-			if (i > 0)
-				return i;
-			// if all the writers are gone, note eof
-			if (_pipeisclosed(fd, p))
-				return 0;
-			// yield and see what happens
-			if (debug)
-				cprintf("devpipe_read yield\n");
-			sys_yield();
-		}
-		// there's a byte.  take it.
-		// wait to increment rpos until the byte is taken!
-		buf[i] = p->p_buf[p->p_rpos % PIPEBUFSIZ];
-		p->p_rpos++;
+	for (i = 0; i < n; i += m) {
+		idx = pipe_index(p->p_rpos);
+		m = MIN(n - i, PIPEBUFSIZ - idx);
+		memmove(buf + i, &p->p_buf[idx], m);
+		p->p_rpos = pipe_advance(p->p_rpos, m);
 	}
-	return i;
+
+	pipe_wakeup(&p->p_rpos, &p->p_wwaiting);
+	return n;
 }
 
 static ssize_t
 devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 {
 	const uint8_t *buf;
-	size_t i;
+	size_t i, m, space, idx;
 	struct Pipe *p;
+	off_t seen;
 
 	p = (struct Pipe*) fd2data(fd);
 	if (debug)
@@ -149,25 +440,32 @@ devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
 
 	buf = vbuf;
-	for (i = 0; i < n; i++) {
-		while (p->p_wpos >= p->p_rpos + sizeof(p->p_buf)) {
+	for (i = 0; i < n; i += m) {
+		// whole pages go straight to a reader that asked for them
+		if (PGOFF(buf + i) == 0 && n - i >= PGSIZE
+		    && (m = pipe_flip_send(p, buf + i, (n - i) / PGSIZE)) > 0)
+			continue;
+
+		while ((seen = p->p_rpos,
+			space = PIPEBUFSIZ - pipe_count(p)) == 0) {
 			// pipe is full
-			// if all the readers are gone
-			// (it's only writers like us now),
-			// note eof
-			if (_pipeisclosed(fd, p))
+			// let the readers drain it before we sleep
+			pipe_wake_readers(p);
+			// sleep until a reader makes room,
+			// or note eof if all the readers are gone
+			// (it's only writers like us now)
+			if (pipe_block(fd, p, &p->p_rpos, seen, &p->p_wwaiting))
 				return 0;
-			// yield and see what happens
-			if (debug)
-				cprintf("devpipe_write yield\n");
-			sys_yield();
 		}
-		// there's room for a byte.  store it.
-		// wait to increment wpos until the byte is stored!
-		p->p_buf[p->p_wpos % PIPEBUFSIZ] = buf[i];
-		p->p_wpos++;
+		// fill as much contiguous free space as we can.
+		// wait to advance wpos until the bytes are stored!
+		idx = pipe_index(p->p_wpos);
+		m = MIN(n - i, MIN(space, PIPEBUFSIZ - idx));
+		memmove(&p->p_buf[idx], buf + i, m);
+		p->p_wpos = pipe_advance(p->p_wpos, m);
 	}
 
+	pipe_wake_readers(p);
 	return i;
 }
 
@@ -176,12 +474,49 @@ devpipe_stat(struct Fd *fd, struct Stat *stat)
 {
 	struct Pipe *p = (struct Pipe*) fd2data(fd);
 	strcpy(stat->st_name, "<pipe>");
-	stat->st_size = p->p_wpos - p->p_rpos;
+	stat->st_size = pipe_count(p);
 	stat->st_isdir = 0;
 	stat->st_dev = &devpipe;
 	return 0;
 }
 
+static int
+devpipe_poll(struct Fd *fd, int events, struct FutexWait *w)
+{
+	struct Pipe *p = (struct Pipe*) fd2data(fd);
+	off_t rpos = p->p_rpos, wpos = p->p_wpos;
+	int refs = pageref(p), r = 0;
+	size_t count;
+
+	// Same order as pipe_block: sample everything we decide on
+	// (and will ask the kernel to re-check) before checking for eof.
+	if (_pipeisclosed(fd, p))
+		return POLLHUP | (events & (POLLIN|POLLOUT));
+
+	count = (wpos - rpos + 2 * PIPEBUFSIZ) % (2 * PIPEBUFSIZ);
+	if ((events & POLLIN) && count != 0)
+		r |= POLLIN;
+	if ((events & POLLOUT) && count != PIPEBUFSIZ)
+		r |= POLLOUT;
+	if (r)
+		return r;
+
+	// Nothing yet: wait for the other end to move its position,
+	// and make sure it knows to wake us when it does.
+	w->fw_refs = refs;
+	if (events & POLLIN) {
+		w->fw_addr = (volatile uint32_t *) &p->p_wpos;
+		w->fw_expected = wpos;
+		xchg(&p->p_rwaiting, 1);
+	} else if (events & POLLOUT) {
+		w->fw_addr = (volatile uint32_t *) &p->p_rpos;
+		w->fw_expected = rpos;
+		xchg(&p->p_wwaiting, 1);
+	} else
+		w->fw_addr = 0;
+	return 0;
+}
+
 static int
 devpipe_close(struct Fd *fd)
 {
@@ -0,0 +1,117 @@
+// Asynchronous system calls: queue requests on the ring page shared
+// with the kernel (see inc/ring.h) and collect their results later,
+// instead of trapping into the kernel once per call.  Nothing is
+// submitted until the next trap; ring_enter forces one.
+//
+// The ring page is PTE_NOCOPY: fork making it copy-on-write would
+// leave the kernel holding a page we no longer have mapped, and
+// sharing it would let children queue calls that run as us (the kernel
+// stops serving a ring anyone else has mapped).  So children don't get
+// it, and a child wanting a ring must ring_init one of its own.
+
+#include <inc/lib.h>
+
+#define compiler_barrier()	__asm __volatile("" : : : "memory")
+
+static struct Ring *ring;
+
+// Set up a ring on a fresh page at 'va'.
+// Returns 0 on success, < 0 on error.
+int
+ring_init(void *va)
+{
+	int r;
+
+	if ((r = sys_page_alloc(0, va, PTE_P|PTE_U|PTE_W|PTE_NOCOPY)) < 0)
+		return r;
+	if ((r = sys_ring_setup(va)) < 0) {
+		sys_page_unmap(0, va);
+		return r;
+	}
+	ring = (struct Ring *) va;
+	return 0;
+}
+
+// Return the next free request slot to fill in, or NULL if the
+// submission ring is full.  The request is only queued once
+// ring_submit is called.
+struct RingSqe *
+ring_get_sqe(void)
+{
+	if (ring->r_sq_tail - ring->r_sq_head == RING_NSLOTS)
+		return NULL;
+	return &ring->r_sq[ring->r_sq_tail % RING_NSLOTS];
+}
+
+// Queue a request for system call 'num', tagged 'data' for matching up
+// its completion.  Returns 0 on success, -E_NO_MEM if the ring is full.
+int
+ring_prep(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3,
+	  uint32_t a4, uint32_t a5, uint32_t data)
+{
+	struct RingSqe *sqe;
+
+	if (!(sqe = ring_get_sqe()))
+		return -E_NO_MEM;
+	sqe->sqe_num = num;
+	sqe->sqe_args[0] = a1;
+	sqe->sqe_args[1] = a2;
+	sqe->sqe_args[2] = a3;
+	sqe->sqe_args[3] = a4;
+	sqe->sqe_args[4] = a5;
+	sqe->sqe_data = data;
+	ring_submit();
+	return 0;
+}
+
+// Queue the request filled in since ring_get_sqe.
+void
+ring_submit(void)
+{
+	uint32_t tail = ring->r_sq_tail;
+
+	compiler_barrier();
+	ring->r_sq_tail = tail + 1;
+}
+
+// Have the kernel run the queued requests now.
+// Returns the number of completions waiting, or < 0 on error.
+int
+ring_enter(void)
+{
+	return sys_ring_enter();
+}
+
+// Return the oldest completion, or NULL if there is none.
+// It stays ours until ring_cqe_seen.
+struct RingCqe *
+ring_peek_cqe(void)
+{
+	if (ring->r_cq_head == ring->r_cq_tail)
+		return NULL;
+	compiler_barrier();
+	return &ring->r_cq[ring->r_cq_head % RING_NSLOTS];
+}
+
+// Give the slot from ring_peek_cqe back to the kernel.
+void
+ring_cqe_seen(void)
+{
+	compiler_barrier();
+	ring->r_cq_head = ring->r_cq_head + 1;
+}
+
+// Return the oldest completion, entering the kernel until there is
+// one.  A send stuck behind a receiver that isn't ready needs that
+// receiver to run, so give up the CPU between tries.
+struct RingCqe *
+ring_wait_cqe(void)
+{
+	struct RingCqe *cqe;
+
+	while (!(cqe = ring_peek_cqe())) {
+		if (ring_enter() == 0)
+			sys_yield();
+	}
+	return cqe;
+}
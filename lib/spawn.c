@@ -10,6 +10,13 @@ static int init_stack(envid_t child, const char **argv, uintptr_t *init_esp);
 static int map_segment(envid_t child, uintptr_t va, size_t memsz,
 		       int fd, size_t filesz, off_t fileoffset, int perm);
 static int copy_shared_pages(envid_t child);
+static int batch_add(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3,
+		     uint32_t a4, uint32_t a5);
+static int batch_flush(void);
+
+// System calls that set up the child, queued to run in one sys_batch.
+static struct SyscallDesc batch[BATCH_MAX];
+static int nbatch;
 
 // Spawn a child process from a program image loaded from the file system.
 // prog: the pathname of the program to run.
@@ -128,17 +135,20 @@ spawn(const char *prog, const char **argv)
 
 	// Copy shared library state.
 	if ((r = copy_shared_pages(child)) < 0)
-		panic("copy_shared_pages: %e", r);
-
-	if ((r = sys_env_set_trapframe(child, &child_tf)) < 0)
-		panic("sys_env_set_trapframe: %e", r);
+		goto error;
 
-	if ((r = sys_env_set_status(child, ENV_RUNNABLE)) < 0)
-		panic("sys_env_set_status: %e", r);
+	// Start the child, along with whatever setup is still queued.
+	if ((r = batch_add(SYS_env_set_trapframe, child, (uint32_t) &child_tf,
+			   0, 0, 0)) < 0
+	    || (r = batch_add(SYS_env_set_status, child, ENV_RUNNABLE,
+			      0, 0, 0)) < 0
+	    || (r = batch_flush()) < 0)
+		goto error;
 
 	return child;
 
 error:
+	nbatch = 0;
 	sys_env_destroy(child);
 	close(fd);
 	return r;
@@ -279,7 +289,8 @@ map_segment(envid_t child, uintptr_t va, size_t memsz,
 	for (i = 0; i < memsz; i += PGSIZE) {
 		if (i >= filesz) {
 			// allocate a blank page
-			if ((r = sys_page_alloc(child, (void*) (va + i), perm)) < 0)
+			if ((r = batch_add(SYS_page_alloc, child, va + i, perm,
+					   0, 0)) < 0)
 				return r;
 		} else {
 			// from file
@@ -315,7 +326,8 @@ copy_shared_pages(envid_t child)
 			if (perm & PTE_P && perm & PTE_SHARE) {
 				void* addr = (void*)(page_num*PGSIZE);
 				cprintf("copying %x\n", addr);
-				int success = sys_page_map(0, addr, child, addr, perm);
+				int success = batch_add(SYS_page_map, 0, (uint32_t) addr,
+							child, (uint32_t) addr, perm);
 				if (success != 0) {
 					return success;
 				}
@@ -327,3 +339,40 @@ copy_shared_pages(envid_t child)
 	return 0;
 }
 
+// Queue system call 'num' to run in the next batch, first running the
+// queued ones if the batch is full.
+// Returns 0 on success, < 0 if a queued call failed.
+static int
+batch_add(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3,
+	  uint32_t a4, uint32_t a5)
+{
+	struct SyscallDesc *d;
+	int r;
+
+	if (nbatch == BATCH_MAX && (r = batch_flush()) < 0)
+		return r;
+	d = &batch[nbatch++];
+	d->sd_num = num;
+	d->sd_args[0] = a1;
+	d->sd_args[1] = a2;
+	d->sd_args[2] = a3;
+	d->sd_args[3] = a4;
+	d->sd_args[4] = a5;
+	d->sd_ret = 0;
+	return 0;
+}
+
+// Run the queued system calls, stopping at the first one that fails.
+// Returns 0 on success, < 0 if a call failed.
+static int
+batch_flush(void)
+{
+	int n = nbatch, r;
+
+	nbatch = 0;
+	if (n == 0)
+		return 0;
+	if ((r = sys_batch(batch, n, BATCH_STOP)) < 0)
+		return r;
+	return batch[r - 1].sd_ret < 0 ? batch[r - 1].sd_ret : 0;
+}
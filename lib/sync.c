@@ -0,0 +1,89 @@
+// Mutexes and condition variables built on the kernel's futex wait queues.
+//
+// Both objects are single words, so they work across environments as long
+// as they live in a page every participant has mapped (e.g. PTE_SHARE).
+// The uncontended paths never enter the kernel.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+void
+mutex_init(struct Mutex *m)
+{
+	m->m_state = 0;
+}
+
+// Acquire 'm', sleeping in the kernel while someone else holds it.
+void
+mutex_lock(struct Mutex *m)
+{
+	uint32_t c;
+
+	// Fast path: 0 -> 1 with nobody to wake later.
+	if ((c = cmpxchg(&m->m_state, 0, 1)) == 0)
+		return;
+
+	// Slow path: mark the mutex contended (2) so the eventual unlock
+	// knows to wake us, and sleep until we are the ones who moved it
+	// from 0.
+	if (c != 2)
+		c = xchg(&m->m_state, 2);
+	while (c != 0) {
+		sys_futex_wait(&m->m_state, 2);
+		c = xchg(&m->m_state, 2);
+	}
+}
+
+// Acquire 'm' only if it is free.  Returns 1 on success, 0 otherwise.
+int
+mutex_trylock(struct Mutex *m)
+{
+	return cmpxchg(&m->m_state, 0, 1) == 0;
+}
+
+void
+mutex_unlock(struct Mutex *m)
+{
+	// Only enter the kernel if someone may be sleeping.
+	if (xchg(&m->m_state, 0) == 2)
+		sys_futex_wake(&m->m_state, 1);
+}
+
+void
+cond_init(struct Cond *c)
+{
+	c->c_seq = 0;
+}
+
+// Atomically release 'm' and wait for a signal on 'c', then reacquire 'm'.
+// As with any condition variable, callers must re-check their predicate:
+// wakeups may be spurious.
+void
+cond_wait(struct Cond *c, struct Mutex *m)
+{
+	uint32_t seq = c->c_seq;
+
+	mutex_unlock(m);
+	// If a signal slipped in after the unlock, c_seq has moved on and
+	// the kernel refuses to put us to sleep.
+	sys_futex_wait(&c->c_seq, seq);
+
+	// We can't tell whether other waiters remain, so take the mutex
+	// in the contended state to make sure our unlock wakes them.
+	while (xchg(&m->m_state, 2) != 0)
+		sys_futex_wait(&m->m_state, 2);
+}
+
+void
+cond_signal(struct Cond *c)
+{
+	__sync_fetch_and_add(&c->c_seq, 1);
+	sys_futex_wake(&c->c_seq, 1);
+}
+
+void
+cond_broadcast(struct Cond *c)
+{
+	__sync_fetch_and_add(&c->c_seq, 1);
+	sys_futex_wake(&c->c_seq, NENV);
+}
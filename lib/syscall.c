@@ -1,35 +1,64 @@
 // System call stubs.
 
+#include <inc/x86.h>
 #include <inc/syscall.h>
 #include <inc/lib.h>
 
+// Whether the CPU has sysenter: 0 if not, 1 if so, -1 until we look.
+static int sysenter_ok = -1;
+
 static inline int32_t
 syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
 {
 	int32_t ret;
+	uint32_t edx;
+
+	if (sysenter_ok < 0) {
+		cpuid(1, NULL, NULL, NULL, &edx);
+		sysenter_ok = (edx & CPUID_FEAT_SEP) != 0;
+	}
 
-	// Generic system call: pass system call number in AX,
-	// up to five parameters in DX, CX, BX, DI, SI.
-	// Interrupt kernel with T_SYSCALL.
-	//
-	// The "volatile" tells the assembler not to optimize
-	// this instruction away just because we don't use the
-	// return value.
-	//
-	// The last clause tells the assembler that this can
-	// potentially change the condition codes and arbitrary
-	// memory locations.
-
-	asm volatile("int %1\n"
-		: "=a" (ret)
-		: "i" (T_SYSCALL),
-		  "a" (num),
-		  "d" (a1),
-		  "c" (a2),
-		  "b" (a3),
-		  "D" (a4),
-		  "S" (a5)
-		: "cc", "memory");
+	// Fast path: enter the kernel with sysenter, which takes the same
+	// registers except that %esi carries our return address and %ebp
+	// our stack pointer.  So only calls without a fifth argument can
+	// use it.  The kernel comes back with sysexit, which uses %edx and
+	// %ecx for the return address and stack pointer.
+	if (a5 == 0 && sysenter_ok) {
+		asm volatile("pushl %%ebp\n"
+			"\tmovl %%esp,%%ebp\n"
+			"\tleal 1f,%%esi\n"
+			"\tsysenter\n"
+			"1:\tpopl %%ebp\n"
+			: "=a" (ret),
+			  "+d" (a1),
+			  "+c" (a2)
+			: "a" (num),
+			  "b" (a3),
+			  "D" (a4)
+			: "esi", "cc", "memory");
+	} else {
+		// Generic system call: pass system call number in AX,
+		// up to five parameters in DX, CX, BX, DI, SI.
+		// Interrupt kernel with T_SYSCALL.
+		//
+		// The "volatile" tells the assembler not to optimize
+		// this instruction away just because we don't use the
+		// return value.
+		//
+		// The last clause tells the assembler that this can
+		// potentially change the condition codes and arbitrary
+		// memory locations.
+		asm volatile("int %1\n"
+			: "=a" (ret)
+			: "i" (T_SYSCALL),
+			  "a" (num),
+			  "d" (a1),
+			  "c" (a2),
+			  "b" (a3),
+			  "D" (a4),
+			  "S" (a5)
+			: "cc", "memory");
+	}
 
 	if(check && ret > 0)
 		panic("syscall %d returned %d (> 0)", num, ret);
@@ -112,8 +141,153 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, int perm)
 }
 
 int
-sys_ipc_recv(void *dstva)
+sys_ipc_send(envid_t envid, uint32_t value, void *srcva, int perm)
+{
+	return syscall(SYS_ipc_send, 0, envid, value, (uint32_t) srcva, perm, 0);
+}
+
+int
+sys_ipc_call(envid_t envid, const struct IpcMsg *msg, void *dstva, int npages,
+	     int timeout)
+{
+	return syscall(SYS_ipc_call, 0, envid, (uint32_t) msg, (uint32_t) dstva, npages, timeout);
+}
+
+int
+sys_ipc_reply_wait(envid_t envid, const struct IpcMsg *msg, void *dstva,
+		   int npages, int timeout)
+{
+	return syscall(SYS_ipc_reply_wait, 0, envid, (uint32_t) msg, (uint32_t) dstva, npages, timeout);
+}
+
+int
+sys_ipc_recv(void *dstva, int timeout)
+{
+	return syscall(SYS_ipc_recv, 1, (uint32_t)dstva, timeout, 0, 0, 0);
+}
+
+int
+sys_ipc_notify(envid_t envid, uint32_t bits)
+{
+	return syscall(SYS_ipc_notify, 0, envid, bits, 0, 0, 0);
+}
+
+
+int
+sys_futex_wait(const volatile uint32_t *addr, uint32_t expected)
 {
-	return syscall(SYS_ipc_recv, 1, (uint32_t)dstva, 0, 0, 0, 0);
+	return syscall(SYS_futex_wait, 0, (uint32_t) addr, expected, 0, 0, 0);
 }
 
+int
+sys_futex_wait_pageref(const volatile uint32_t *addr, uint32_t expected, int refs)
+{
+	return syscall(SYS_futex_wait, 0, (uint32_t) addr, expected, refs, 0, 0);
+}
+
+int
+sys_futex_wake(const volatile uint32_t *addr, int n)
+{
+	return syscall(SYS_futex_wake, 0, (uint32_t) addr, n, 0, 0, 0);
+}
+
+int
+sys_page_accept(void *va, size_t len, void *keyva)
+{
+	return syscall(SYS_page_accept, 1, (uint32_t) va, len, (uint32_t) keyva, 0, 0);
+}
+
+int
+sys_page_flip(void *srcva, envid_t dstenv, void *dstva, void *keyva, int perm)
+{
+	return syscall(SYS_page_flip, 0, (uint32_t) srcva, dstenv,
+		       (uint32_t) dstva, (uint32_t) keyva, perm);
+}
+
+int
+sys_futex_waitv(const struct FutexWait *w, int n, int timeout)
+{
+	return syscall(SYS_futex_waitv, 0, (uint32_t) w, n, timeout, 0, 0);
+}
+
+unsigned int
+sys_time_msec(void)
+{
+	return (unsigned int) syscall(SYS_time_msec, 0, 0, 0, 0, 0, 0);
+}
+
+uint64_t
+sys_time_nsec(void)
+{
+	// Write 'nsec' ourselves first, in case the stack page is
+	// copy-on-write: the kernel won't fault it in for us.
+	uint64_t nsec = 0;
+
+	syscall(SYS_time_nsec, 1, (uint32_t) &nsec, 0, 0, 0, 0);
+	return nsec;
+}
+
+int
+sys_service_register(const char *name)
+{
+	return syscall(SYS_service_register, 0, (uint32_t) name, strlen(name), 0, 0, 0);
+}
+
+envid_t
+sys_service_lookup(const char *name)
+{
+	return syscall(SYS_service_lookup, 0, (uint32_t) name, strlen(name), 0, 0, 0);
+}
+
+int
+sys_batch(struct SyscallDesc *d, int n, int flags)
+{
+	return syscall(SYS_batch, 0, (uint32_t) d, n, flags, 0, 0);
+}
+
+int
+sys_ring_setup(void *va)
+{
+	return syscall(SYS_ring_setup, 1, (uint32_t) va, 0, 0, 0, 0);
+}
+
+int
+sys_ring_enter(void)
+{
+	return syscall(SYS_ring_enter, 0, 0, 0, 0, 0, 0);
+}
+
+int
+sys_env_stats(envid_t envid, struct EnvStats *stats)
+{
+	// Touch the buffer first, so that a copy-on-write page is ours
+	// before the kernel writes to it.
+	memset(stats, 0, sizeof(*stats));
+	return syscall(SYS_env_stats, 1, envid, (uint32_t) stats, 0, 0, 0);
+}
+
+int
+sys_env_trace(envid_t envid, void *va)
+{
+	return syscall(SYS_env_trace, 1, envid, (uint32_t) va, 0, 0, 0);
+}
+
+int
+sys_ktrace(int on)
+{
+	return syscall(SYS_ktrace, 0, on, 0, 0, 0, 0);
+}
+
+int
+sys_ktrace_map(void *va)
+{
+	return syscall(SYS_ktrace_map, 0, (uint32_t) va, 0, 0, 0, 0);
+}
+
+int
+sys_perf_read(envid_t envid, struct PerfCounts *pc)
+{
+	// As for sys_env_stats.
+	memset(pc, 0, sizeof(*pc));
+	return syscall(SYS_perf_read, 0, envid, (uint32_t) pc, 0, 0, 0);
+}
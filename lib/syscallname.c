@@ -0,0 +1,50 @@
+// System call names, for tracing.  Shared by the kernel and user space.
+
+#include <inc/syscall.h>
+
+static const char * const syscall_names[NSYSCALLS] = {
+	[SYS_cputs] = "cputs",
+	[SYS_cgetc] = "cgetc",
+	[SYS_getenvid] = "getenvid",
+	[SYS_env_destroy] = "env_destroy",
+	[SYS_page_alloc] = "page_alloc",
+	[SYS_page_map] = "page_map",
+	[SYS_page_unmap] = "page_unmap",
+	[SYS_exofork] = "exofork",
+	[SYS_env_set_status] = "env_set_status",
+	[SYS_env_set_trapframe] = "env_set_trapframe",
+	[SYS_env_set_pgfault_upcall] = "env_set_pgfault_upcall",
+	[SYS_yield] = "yield",
+	[SYS_ipc_try_send] = "ipc_try_send",
+	[SYS_ipc_recv] = "ipc_recv",
+	[SYS_futex_wait] = "futex_wait",
+	[SYS_futex_wake] = "futex_wake",
+	[SYS_page_accept] = "page_accept",
+	[SYS_page_flip] = "page_flip",
+	[SYS_futex_waitv] = "futex_waitv",
+	[SYS_time_msec] = "time_msec",
+	[SYS_ipc_send] = "ipc_send",
+	[SYS_ipc_call] = "ipc_call",
+	[SYS_ipc_reply_wait] = "ipc_reply_wait",
+	[SYS_service_register] = "service_register",
+	[SYS_service_lookup] = "service_lookup",
+	[SYS_ipc_notify] = "ipc_notify",
+	[SYS_time_nsec] = "time_nsec",
+	[SYS_batch] = "batch",
+	[SYS_ring_setup] = "ring_setup",
+	[SYS_ring_enter] = "ring_enter",
+	[SYS_env_stats] = "env_stats",
+	[SYS_env_trace] = "env_trace",
+	[SYS_ktrace] = "ktrace",
+	[SYS_ktrace_map] = "ktrace_map",
+	[SYS_perf_read] = "perf_read",
+};
+
+// Return the name of system call 'num', or "?" if there is none.
+const char *
+syscall_name(uint32_t num)
+{
+	if (num < NSYSCALLS && syscall_names[num])
+		return syscall_names[num];
+	return "?";
+}
@@ -0,0 +1,19 @@
+// Questions answered from this environment's data page at UVDSO,
+// without a system call.
+
+#include <inc/lib.h>
+
+// Return our env id, as sys_getenvid does.
+envid_t
+getenvid(void)
+{
+	return vdso.vd_envid;
+}
+
+// Return the CPU we are running on.  We may have moved by the time the
+// caller looks at the answer.
+int
+getcpu(void)
+{
+	return vdso.vd_cpunum;
+}
@@ -5,9 +5,12 @@ void
 wait(envid_t envid)
 {
 	const volatile struct Env *e;
+	uint32_t status;
 
 	assert(envid != 0);
 	e = &envs[ENVX(envid)];
-	while (e->env_id == envid && e->env_status != ENV_FREE)
-		sys_yield();
+	while (e->env_id == envid && (status = e->env_status) != ENV_FREE)
+		// The kernel wakes waiters on env_status when it frees 'e'.
+		// If the status changed in the meantime, this returns at once.
+		sys_futex_wait(&e->env_status, status);
 }
@@ -1,6 +1,7 @@
 #include <inc/lib.h>
 
-char buf[8192];
+// Page-aligned so that pipes can pass whole pages instead of copying.
+char buf[8192] __attribute__ ((aligned(PGSIZE)));
 
 void
 cat(int f, char *s)
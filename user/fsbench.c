@@ -0,0 +1,61 @@
+// File server round-trip benchmark: time small fstat and read
+// requests, which travel over this environment's channel to the
+// server, and whole-file reads, which come back as a run of pages.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NITER	1000
+
+char bigbuf[IPC_MAXPAGES * PGSIZE];
+
+void
+umain(int argc, char **argv)
+{
+	int fd, i, r;
+	struct Stat st;
+	char buf[16];
+	uint64_t start, cycles;
+
+	binaryname = "fsbench";
+
+	if ((fd = open("/motd", O_RDONLY)) < 0)
+		panic("open /motd: %e", fd);
+
+	start = read_tsc();
+	for (i = 0; i < NITER; i++)
+		if ((r = fstat(fd, &st)) < 0)
+			panic("fstat: %e", r);
+	cycles = read_tsc() - start;
+	cprintf("fsbench: fstat %llu cycles/call\n", cycles / NITER);
+
+	start = read_tsc();
+	for (i = 0; i < NITER; i++) {
+		seek(fd, 0);
+		if ((r = read(fd, buf, sizeof(buf))) != sizeof(buf))
+			panic("read: %d", r);
+	}
+	cycles = read_tsc() - start;
+	cprintf("fsbench: %d-byte read %llu cycles/call\n", sizeof(buf),
+		cycles / NITER);
+
+	close(fd);
+
+	// Our own binary is big enough to take several pages per read.
+	if ((fd = open("/fsbench", O_RDONLY)) < 0)
+		panic("open /fsbench: %e", fd);
+	if ((r = fstat(fd, &st)) < 0)
+		panic("fstat: %e", r);
+	st.st_size = MIN(st.st_size, sizeof(bigbuf));
+	start = read_tsc();
+	for (i = 0; i < NITER / 10; i++) {
+		seek(fd, 0);
+		if ((r = readn(fd, bigbuf, st.st_size)) != st.st_size)
+			panic("readn: %d, want %d", r, st.st_size);
+	}
+	cycles = read_tsc() - start;
+	cprintf("fsbench: %d-byte whole-file read %llu cycles/call\n", st.st_size,
+		cycles / (NITER / 10));
+
+	close(fd);
+}
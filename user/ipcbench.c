@@ -0,0 +1,201 @@
+// IPC microbenchmarks, timed with the TSC: call and send/receive round
+// trips (split by whether the other side ran on our CPU), one-way
+// throughput, page transfers, and several clients calling one server.
+// Each result is a line "ipcbench: <name> <n> ops <c> cycles/op";
+// the bench-ipc script boots JOS on one CPU and on two and tabulates
+// them.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NROUND		10000
+#define NPAGECALL	1000
+#define MAXCLIENTS	8
+
+// Pages we send, and the window the call server receives them in.
+#define SENDVA		((void *) 0xA0000000)
+#define RECVVA		((void *) 0xB0000000)
+
+static void
+report(const char *name, uint32_t n, uint64_t cycles)
+{
+	if (n)
+		cprintf("ipcbench: %s %d ops %llu cycles/op\n",
+			name, n, cycles / n);
+}
+
+// Answer calls forever, replying with the CPU we ran on.
+static void
+call_server(void)
+{
+	struct IpcMsg reply;
+	envid_t whom = 0;
+
+	reply.im_srcva = (void *) UTOP;
+	reply.im_perm = 0;
+	reply.im_npages = 0;
+	reply.im_nwords = 0;
+	while (1) {
+		reply.im_value = thisenv->env_cpunum;
+		ipc_reply_wait(whom, &reply, &whom, RECVVA, IPC_MAXPAGES,
+			       NULL, -1);
+	}
+}
+
+// Receive messages forever, answering each 0 with the CPU we ran on.
+static void
+send_server(void)
+{
+	envid_t whom;
+
+	while (1)
+		if (ipc_recv(&whom, 0, 0) == 0)
+			ipc_send(whom, thisenv->env_cpunum, 0, 0);
+}
+
+static envid_t
+start_server(void (*server)(void))
+{
+	envid_t e;
+
+	if ((e = fork()) < 0)
+		panic("fork: %e", e);
+	if (e == 0) {
+		server();
+		exit();
+	}
+	return e;
+}
+
+// Round trips with sys_ipc_call, and with a send and then a receive.
+static void
+bench_rtt(envid_t csrv, envid_t ssrv)
+{
+	uint64_t t, cycles[2];
+	uint32_t n[2];
+	int i, cross;
+
+	cycles[0] = cycles[1] = n[0] = n[1] = 0;
+	for (i = 0; i < NROUND; i++) {
+		t = read_tsc();
+		cross = ipc_call(csrv, 0, NULL, 0, NULL, NULL)
+			!= thisenv->env_cpunum;
+		cycles[cross] += read_tsc() - t;
+		n[cross]++;
+	}
+	report("call-same", n[0], cycles[0]);
+	report("call-cross", n[1], cycles[1]);
+
+	cycles[0] = cycles[1] = n[0] = n[1] = 0;
+	for (i = 0; i < NROUND; i++) {
+		t = read_tsc();
+		ipc_send(ssrv, 0, 0, 0);
+		cross = ipc_recv(NULL, 0, 0) != thisenv->env_cpunum;
+		cycles[cross] += read_tsc() - t;
+		n[cross]++;
+	}
+	report("sendrecv-same", n[0], cycles[0]);
+	report("sendrecv-cross", n[1], cycles[1]);
+}
+
+// One-way throughput: NROUND sends, then one round trip to
+// make sure they have all arrived.
+static void
+bench_oneway(envid_t ssrv)
+{
+	uint64_t t;
+	int i;
+
+	t = read_tsc();
+	for (i = 0; i < NROUND; i++)
+		ipc_send(ssrv, 1, 0, 0);
+	ipc_send(ssrv, 0, 0, 0);
+	ipc_recv(NULL, 0, 0);
+	report("oneway", NROUND, read_tsc() - t);
+}
+
+// Calls that each carry 'npages' pages.
+static void
+bench_pages(envid_t csrv, int npages)
+{
+	struct IpcMsg msg;
+	char name[16];
+	uint64_t t;
+	int i, r;
+
+	msg.im_value = 0;
+	msg.im_srcva = SENDVA;
+	msg.im_perm = PTE_P|PTE_U;
+	msg.im_npages = npages;
+	msg.im_nwords = 0;
+	t = read_tsc();
+	for (i = 0; i < NPAGECALL; i++)
+		if ((r = ipc_callmsg(csrv, &msg, NULL, 0, NULL, -1)) < 0)
+			panic("page call: %e", r);
+	snprintf(name, sizeof(name), "pages-%d", npages);
+	report(name, NPAGECALL, read_tsc() - t);
+}
+
+// 'nclients' clients calling one server at once.  Reports the cycles
+// per call for all of them together.
+static void
+bench_fanin(envid_t csrv, int nclients)
+{
+	envid_t kids[MAXCLIENTS];
+	char name[16];
+	uint64_t t;
+	int i, j, r;
+
+	for (i = 0; i < nclients; i++) {
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %e", kids[i]);
+		if (kids[i] == 0) {
+			ipc_recv(NULL, 0, 0);
+			for (j = 0; j < NROUND / nclients; j++)
+				if ((r = ipc_call(csrv, 0, NULL, 0, NULL, NULL)) < 0)
+					panic("fan-in call: %e", r);
+			ipc_send(thisenv->env_parent_id, 0, 0, 0);
+			exit();
+		}
+	}
+
+	t = read_tsc();
+	for (i = 0; i < nclients; i++)
+		ipc_send(kids[i], 0, 0, 0);
+	for (i = 0; i < nclients; i++)
+		ipc_recv(NULL, 0, 0);
+	t = read_tsc() - t;
+	snprintf(name, sizeof(name), "fanin-%d", nclients);
+	report(name, NROUND / nclients * nclients, t);
+
+	for (i = 0; i < nclients; i++)
+		wait(kids[i]);
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t csrv, ssrv;
+	int i, r;
+
+	binaryname = "ipcbench";
+
+	for (i = 0; i < IPC_MAXPAGES; i++)
+		if ((r = sys_page_alloc(0, SENDVA + i * PGSIZE,
+					PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc: %e", r);
+
+	csrv = start_server(call_server);
+	ssrv = start_server(send_server);
+
+	bench_rtt(csrv, ssrv);
+	bench_oneway(ssrv);
+	bench_pages(csrv, 1);
+	bench_pages(csrv, IPC_MAXPAGES);
+	for (i = 1; i <= MAXCLIENTS; i *= 2)
+		bench_fanin(csrv, i);
+
+	sys_env_destroy(csrv);
+	sys_env_destroy(ssrv);
+	cprintf("ipcbench: done\n");
+}
@@ -0,0 +1,71 @@
+// Pipe throughput benchmark: push several megabytes through /cat
+// and report how many TSC cycles the whole transfer took.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NBYTES	(4 * 1024 * 1024)
+#define CHUNK	8192
+
+char buf[CHUNK] __attribute__ ((aligned(PGSIZE)));
+
+void
+umain(int argc, char **argv)
+{
+	int in[2], out[2], r, n;
+	envid_t spawner, writer;
+	uint32_t total;
+	uint64_t start, cycles;
+
+	binaryname = "pipebench";
+
+	if ((r = pipe(in)) < 0 || (r = pipe(out)) < 0)
+		panic("pipe: %e", r);
+
+	// cat reads 'in' as its stdin and writes 'out' as its stdout.
+	if ((r = fork()) < 0)
+		panic("fork: %e", r);
+	if (r == 0) {
+		dup(in[0], 0);
+		dup(out[1], 1);
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		if ((r = spawnl("/cat", "cat", (char *) 0)) < 0)
+			panic("spawn cat: %e", r);
+		exit();
+	}
+	spawner = r;
+	close(in[0]);
+	close(out[1]);
+
+	start = read_tsc();
+
+	// A separate writer keeps the pipeline full while we drain it.
+	if ((r = fork()) < 0)
+		panic("fork: %e", r);
+	if (r == 0) {
+		close(out[0]);
+		memset(buf, 'x', sizeof(buf));
+		for (total = 0; total < NBYTES; total += n)
+			if ((n = write(in[1], buf, sizeof(buf))) != sizeof(buf))
+				panic("write: %d %e", n, n >= 0 ? 0 : n);
+		exit();
+	}
+	writer = r;
+	close(in[1]);
+
+	for (total = 0; (n = read(out[0], buf, sizeof(buf))) > 0; total += n)
+		;
+	if (n < 0)
+		panic("read: %e", n);
+	cycles = read_tsc() - start;
+
+	wait(writer);
+	wait(spawner);
+	if (total != NBYTES)
+		panic("got %d bytes, want %d", total, NBYTES);
+	cprintf("pipebench: %d bytes in %llu cycles, %llu cycles/byte\n",
+		total, cycles, cycles / total);
+}
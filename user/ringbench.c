@@ -0,0 +1,130 @@
+// Asynchronous system calls against direct ones, timed with the TSC:
+// allocating and unmapping pages, and sending IPC to a child that
+// receives in a loop.  Each result is a line
+// "ringbench: <name> <n> ops <c> cycles/op".
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NOPS		10000
+#define NSENDS		10000
+
+#define RINGVA		((void *) 0xA0000000)
+// Pages allocated and unmapped again; one per pair of requests queued.
+#define PAGEVA		((void *) 0xA0100000)
+#define NBATCH		(RING_NSLOTS / 2)
+
+static void
+report(const char *name, uint32_t n, uint64_t cycles)
+{
+	cprintf("ringbench: %s %d ops %llu cycles/op\n", name, n, cycles / n);
+}
+
+// Collect 'n' completions, panicking on any failure.
+static void
+reap(int n)
+{
+	struct RingCqe *cqe;
+
+	while (n-- > 0) {
+		cqe = ring_wait_cqe();
+		if (cqe->cqe_ret < 0)
+			panic("request %d failed: %e", cqe->cqe_data, cqe->cqe_ret);
+		ring_cqe_seen();
+	}
+}
+
+static void
+bench_pages(void)
+{
+	uint64_t t;
+	void *va;
+	int i, j, r;
+
+	t = read_tsc();
+	for (i = 0; i < NOPS; i++) {
+		va = PAGEVA + (i % NBATCH) * PGSIZE;
+		if ((r = sys_page_alloc(0, va, PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc: %e", r);
+		if ((r = sys_page_unmap(0, va)) < 0)
+			panic("sys_page_unmap: %e", r);
+	}
+	report("pages-direct", NOPS, read_tsc() - t);
+
+	t = read_tsc();
+	for (i = 0; i < NOPS; i += NBATCH) {
+		for (j = 0; j < NBATCH; j++) {
+			va = PAGEVA + j * PGSIZE;
+			ring_prep(SYS_page_alloc, 0, (uint32_t) va,
+				  PTE_P|PTE_U|PTE_W, 0, 0, i + j);
+			ring_prep(SYS_page_unmap, 0, (uint32_t) va,
+				  0, 0, 0, i + j);
+		}
+		ring_enter();
+		reap(2 * NBATCH);
+	}
+	report("pages-ring", NOPS, read_tsc() - t);
+}
+
+// Receive NSENDS messages, then tell the parent.
+static void
+receiver(void)
+{
+	envid_t parent = thisenv->env_parent_id;
+	int i;
+
+	while (1) {
+		for (i = 0; i < NSENDS; i++)
+			ipc_recv(NULL, 0, 0);
+		ipc_send(parent, 0, 0, 0);
+	}
+}
+
+static void
+bench_send(envid_t rcv)
+{
+	uint64_t t;
+	int i, n;
+
+	t = read_tsc();
+	for (i = 0; i < NSENDS; i++)
+		ipc_send(rcv, i, 0, 0);
+	ipc_recv(NULL, 0, 0);
+	report("send-direct", NSENDS, read_tsc() - t);
+
+	t = read_tsc();
+	for (i = 0; i < NSENDS; i += n) {
+		for (n = 0; i + n < NSENDS && n < RING_NSLOTS; n++)
+			ring_prep(SYS_ipc_try_send, rcv, i + n, UTOP, 0, 0,
+				  i + n);
+		ring_enter();
+		reap(n);
+	}
+	ipc_recv(NULL, 0, 0);
+	report("send-ring", NSENDS, read_tsc() - t);
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t rcv;
+	int r;
+
+	binaryname = "ringbench";
+
+	if ((r = ring_init(RINGVA)) < 0)
+		panic("ring_init: %e", r);
+
+	bench_pages();
+
+	if ((rcv = fork()) < 0)
+		panic("fork: %e", rcv);
+	if (rcv == 0) {
+		receiver();
+		exit();
+	}
+	bench_send(rcv);
+	sys_env_destroy(rcv);
+
+	cprintf("ringbench: done\n");
+}
@@ -0,0 +1,96 @@
+// Run a program, printing each system call it (and anything it starts)
+// makes, then a summary of its system calls, faults, and interrupts.
+//
+//	strace prog [args...]
+
+#include <inc/lib.h>
+
+#define TRACEVA		((void *) 0xA0000000)
+
+static struct TraceRing *tr = TRACEVA;
+static uint32_t seen;
+static envid_t self;
+
+// Print records up to (not including) 'head', except our own.
+static void
+print_trace(uint32_t head)
+{
+	struct TraceEntry *te;
+
+	if (head - seen > TRACE_NENTRIES) {
+		printf("strace: lost %d records\n", head - seen - TRACE_NENTRIES);
+		seen = head - TRACE_NENTRIES;
+	}
+	for (; seen != head; seen++) {
+		te = &tr->tr_ent[seen % TRACE_NENTRIES];
+		if (te->te_envid == self)
+			continue;
+		printf("[%08x] %s(%x, %x, %x, %x, %x) = %d, %u cycles\n",
+		       te->te_envid, syscall_name(te->te_num),
+		       te->te_args[0], te->te_args[1], te->te_args[2],
+		       te->te_args[3], te->te_args[4], te->te_ret,
+		       te->te_cycles);
+	}
+}
+
+static void
+print_stats(struct EnvStats *stats)
+{
+	int i;
+
+	printf("%-20s %10s %16s\n", "", "count", "cycles");
+	for (i = 0; i < NSYSCALLS; i++)
+		if (stats->es_syscalls[i])
+			printf("%-20s %10u %16llu\n", syscall_name(i),
+			       stats->es_syscalls[i], stats->es_syscall_cycles[i]);
+	printf("%-20s %10u %16llu\n", "page faults",
+	       stats->es_pgfaults, stats->es_pgfault_cycles);
+	printf("%-20s %10u\n", "  copy-on-write", stats->es_cowfaults);
+	printf("%-20s %10u %16llu\n", "interrupts",
+	       stats->es_intrs, stats->es_intr_cycles);
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct EnvStats stats, snap;
+	const volatile struct Env *e;
+	envid_t child;
+	int r;
+
+	binaryname = "strace";
+	if (argc < 2) {
+		printf("usage: strace prog [args...]\n");
+		exit();
+	}
+	self = thisenv->env_id;
+
+	// Trace ourselves just long enough for spawn's sys_exofork to
+	// pass the ring on to the child.
+	if ((r = sys_page_alloc(0, TRACEVA, PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_alloc: %e", r);
+	if ((r = sys_env_trace(0, TRACEVA)) < 0)
+		panic("sys_env_trace: %e", r);
+	child = spawn(argv[1], (const char **) argv + 1);
+	if ((r = sys_env_trace(0, NULL)) < 0)
+		panic("sys_env_trace: %e", r);
+	if (child < 0)
+		panic("spawn %s: %e", argv[1], child);
+
+	// The newest record may belong to a call still in progress, so
+	// leave it until the child is gone.  Its counters go with it, so
+	// keep the last ones we saw.
+	memset(&stats, 0, sizeof(stats));
+	e = &envs[ENVX(child)];
+	while (e->env_id == child && e->env_status != ENV_FREE) {
+		if (tr->tr_head != seen)
+			print_trace(tr->tr_head - 1);
+		if (sys_env_stats(child, &snap) == 0)
+			stats = snap;
+		sys_yield();
+	}
+	print_trace(tr->tr_head);
+
+	printf("strace: %s\n", argv[1]);
+	print_stats(&stats);
+}
@@ -0,0 +1,79 @@
+// Null system call cost, timed with the TSC: sys_getenvid through the
+// library, which uses sysenter when the CPU has it, and the same call
+// made with int $T_SYSCALL.  Each result is a line
+// "sysbench: <name> <n> ops <c> cycles/op", followed, if the CPU has
+// performance counters, by "sysbench: <name> <i> instructions/op
+// <m> cache-misses/kop" (per thousand calls).
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NCALLS		100000
+
+static struct PerfCounts perf_start;
+
+static void
+start(void)
+{
+	sys_perf_read(0, &perf_start);
+}
+
+static void
+report(const char *name, uint32_t n, uint64_t cycles)
+{
+	struct PerfCounts p;
+	uint32_t want = (1 << PERF_INSTRUCTIONS) | (1 << PERF_CACHE_MISSES);
+
+	cprintf("sysbench: %s %d ops %llu cycles/op\n", name, n, cycles / n);
+	if (sys_perf_read(0, &p) < 0 || (p.pc_valid & want) != want)
+		return;
+	cprintf("sysbench: %s %llu instructions/op %llu cache-misses/kop\n", name,
+		(p.pc_env[PERF_INSTRUCTIONS] - perf_start.pc_env[PERF_INSTRUCTIONS]) / n,
+		(p.pc_env[PERF_CACHE_MISSES] - perf_start.pc_env[PERF_CACHE_MISSES])
+		* 1000 / n);
+}
+
+static inline envid_t
+getenvid_int(void)
+{
+	envid_t ret;
+
+	asm volatile("int %1"
+		: "=a" (ret)
+		: "i" (T_SYSCALL),
+		  "a" (SYS_getenvid)
+		: "cc", "memory");
+	return ret;
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t edx;
+	uint64_t t;
+	int i;
+
+	binaryname = "sysbench";
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (!(edx & CPUID_FEAT_SEP))
+		cprintf("sysbench: no sysenter, library uses int\n");
+
+	// Warm up both paths first.
+	sys_getenvid();
+	getenvid_int();
+
+	start();
+	t = read_tsc();
+	for (i = 0; i < NCALLS; i++)
+		sys_getenvid();
+	report("sysenter", NCALLS, read_tsc() - t);
+
+	start();
+	t = read_tsc();
+	for (i = 0; i < NCALLS; i++)
+		getenvid_int();
+	report("int", NCALLS, read_tsc() - t);
+
+	cprintf("sysbench: done\n");
+}
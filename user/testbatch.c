@@ -0,0 +1,88 @@
+// Test sys_batch: results come back per call, BATCH_STOP stops at the
+// first failure, and calls that could block are refused.
+
+#include <inc/lib.h>
+
+#define VA1	((void *) 0xA0000000)
+#define VA2	((void *) 0xA0001000)
+#define VA3	((void *) 0xA0002000)
+
+static struct SyscallDesc d[BATCH_MAX + 1];
+
+static void
+set(int i, uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3,
+    uint32_t a4, uint32_t a5)
+{
+	d[i].sd_num = num;
+	d[i].sd_args[0] = a1;
+	d[i].sd_args[1] = a2;
+	d[i].sd_args[2] = a3;
+	d[i].sd_args[3] = a4;
+	d[i].sd_args[4] = a5;
+	d[i].sd_ret = 1;
+}
+
+static bool
+mapped(void *va)
+{
+	return (uvpd[PDX(va)] & PTE_P) && (uvpt[PGNUM(va)] & PTE_P);
+}
+
+void
+umain(int argc, char **argv)
+{
+	int i, r;
+
+	binaryname = "testbatch";
+
+	// Allocate, alias, and drop the original, all in one go.
+	set(0, SYS_page_alloc, 0, (uint32_t) VA1, PTE_P|PTE_U|PTE_W, 0, 0);
+	set(1, SYS_page_map, 0, (uint32_t) VA1, 0, (uint32_t) VA2,
+	    PTE_P|PTE_U|PTE_W);
+	set(2, SYS_page_unmap, 0, (uint32_t) VA1, 0, 0, 0);
+	set(3, SYS_getenvid, 0, 0, 0, 0, 0);
+	if ((r = sys_batch(d, 4, 0)) != 4)
+		panic("batch ran %d calls, want 4", r);
+	for (i = 0; i < 3; i++)
+		if (d[i].sd_ret != 0)
+			panic("call %d returned %e", i, d[i].sd_ret);
+	if (d[3].sd_ret != sys_getenvid())
+		panic("getenvid in batch returned %08x", d[3].sd_ret);
+	if (mapped(VA1) || !mapped(VA2))
+		panic("batch left the wrong pages mapped");
+	cprintf("batch ok\n");
+
+	// The middle call fails: BATCH_STOP skips the rest.
+	set(0, SYS_page_unmap, 0, (uint32_t) VA2, 0, 0, 0);
+	set(1, SYS_page_alloc, 0, UTOP, PTE_P|PTE_U|PTE_W, 0, 0);
+	set(2, SYS_page_alloc, 0, (uint32_t) VA3, PTE_P|PTE_U|PTE_W, 0, 0);
+	if ((r = sys_batch(d, 3, BATCH_STOP)) != 2)
+		panic("stopping batch ran %d calls, want 2", r);
+	if (d[0].sd_ret != 0 || d[1].sd_ret != -E_INVAL || d[2].sd_ret != 1)
+		panic("stopping batch returned %d %d %d",
+		      d[0].sd_ret, d[1].sd_ret, d[2].sd_ret);
+	if (mapped(VA2) || mapped(VA3))
+		panic("stopping batch left pages mapped");
+
+	// Without it, the calls after the failure still run.
+	set(0, SYS_page_alloc, 0, UTOP, PTE_P|PTE_U|PTE_W, 0, 0);
+	set(1, SYS_page_alloc, 0, (uint32_t) VA3, PTE_P|PTE_U|PTE_W, 0, 0);
+	if ((r = sys_batch(d, 2, 0)) != 2 || d[1].sd_ret != 0 || !mapped(VA3))
+		panic("batch stopped at a failure without BATCH_STOP");
+	cprintf("batch stop ok\n");
+
+	set(0, SYS_yield, 0, 0, 0, 0, 0);
+	set(1, SYS_batch, (uint32_t) d, 1, 0, 0, 0);
+	if ((r = sys_batch(d, 2, 0)) != 2
+	    || d[0].sd_ret != -E_INVAL || d[1].sd_ret != -E_INVAL)
+		panic("batch ran a blocking call");
+	// Only calls known not to block run, so this doesn't destroy us.
+	set(0, SYS_env_destroy, 0, 0, 0, 0, 0);
+	set(1, NSYSCALLS, 0, 0, 0, 0, 0);
+	if ((r = sys_batch(d, 2, 0)) != 2
+	    || d[0].sd_ret != -E_INVAL || d[1].sd_ret != -E_INVAL)
+		panic("batch ran a call it doesn't allow");
+	if ((r = sys_batch(d, BATCH_MAX + 1, 0)) != -E_INVAL)
+		panic("oversized batch returned %d", r);
+	cprintf("batch refuse ok\n");
+}
@@ -0,0 +1,61 @@
+// Test channels: a child echoes back everything its parent sends,
+// enough messages to wrap both rings many times over.
+
+#include <inc/lib.h>
+
+#define NMSGS	1000
+#define CHANVA	((void *) 0xA0000000)
+
+void
+umain(int argc, char **argv)
+{
+	struct Chan c;
+	struct ChanMsg *m;
+	envid_t child;
+	uint32_t sent, got, v;
+	int r;
+
+	binaryname = "testchan";
+
+	if ((r = chan_create(&c, CHANVA, PTE_SHARE)) < 0)
+		panic("chan_create: %e", r);
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		chan_attach(&c, CHANVA);
+		for (got = 0; got < NMSGS; got++) {
+			chan_recv_wait(&c);
+			m = chan_recv_begin(&c);
+			v = m->cm_value;
+			chan_recv_end(&c);
+			// Our reply ring can't fill: the parent never has more
+			// than CHAN_NSLOTS messages outstanding.
+			m = chan_send_begin(&c);
+			assert(m);
+			m->cm_value = v * 2;
+			m->cm_len = 0;
+			chan_send_end(&c);
+		}
+		exit();
+	}
+
+	// Keep the child's ring full, so both sides take turns sleeping.
+	for (sent = got = 0; got < NMSGS; ) {
+		while (sent < NMSGS && sent - got < CHAN_NSLOTS) {
+			m = chan_send_begin(&c);
+			assert(m);
+			m->cm_value = sent++;
+			m->cm_len = 0;
+			chan_send_end(&c);
+		}
+		chan_recv_wait(&c);
+		m = chan_recv_begin(&c);
+		if (m->cm_value != got * 2)
+			panic("reply %d is %d", got, m->cm_value);
+		chan_recv_end(&c);
+		got++;
+	}
+	wait(child);
+	cprintf("chan ok\n");
+}
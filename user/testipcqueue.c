@@ -0,0 +1,34 @@
+// Test that blocked IPC senders queue up in the kernel and are
+// received in the order they started sending.
+
+#include <inc/lib.h>
+
+#define NSEND	5
+
+void
+umain(int argc, char **argv)
+{
+	envid_t parent = thisenv->env_id, kids[NSEND], from;
+	int i, r;
+
+	for (i = 0; i < NSEND; i++) {
+		if ((r = fork()) < 0)
+			panic("fork: %e", r);
+		if (r == 0) {
+			ipc_send(parent, i, 0, 0);
+			exit();
+		}
+		kids[i] = r;
+		// Let this child block in its send before forking the next.
+		while (envs[ENVX(r)].env_status != ENV_NOT_RUNNABLE)
+			sys_yield();
+	}
+
+	for (i = 0; i < NSEND; i++) {
+		r = ipc_recv(&from, 0, 0);
+		if (r != i || from != kids[i])
+			panic("got %d from %08x, want %d from %08x",
+			      r, from, i, kids[i]);
+	}
+	cprintf("ipc queue ok\n");
+}
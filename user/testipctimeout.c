@@ -0,0 +1,68 @@
+// Test IPC receive and call timeouts, and notifications.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	struct IpcMsg msg;
+	envid_t parent, child, from;
+	unsigned start;
+	int r;
+
+	binaryname = "testipctimeout";
+	parent = thisenv->env_id;
+
+	if ((r = ipc_recv_timeout(&from, 0, 0, 0)) != -E_TIMEOUT)
+		panic("poll receive returned %d", r);
+	start = sys_time_msec();
+	if ((r = ipc_recv_timeout(&from, 0, 0, 30)) != -E_TIMEOUT)
+		panic("timed receive returned %d", r);
+	if (sys_time_msec() - start < 30)
+		panic("receive timed out after %d ms", sys_time_msec() - start);
+	cprintf("recv timeout ok\n");
+
+	// Notifications pile up while nobody is receiving.
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		sys_ipc_notify(parent, 0x1);
+		sys_ipc_notify(parent, 0x4);
+		exit();
+	}
+	wait(child);
+	if ((r = ipc_recv_timeout(&from, 0, 0, 0)) != 0x5 || from != 0)
+		panic("pending notify: %x from %08x", r, from);
+	if ((r = ipc_recv_timeout(&from, 0, 0, 0)) != -E_TIMEOUT)
+		panic("notify delivered twice: %d", r);
+	cprintf("notify ok\n");
+
+	// A notification wakes a receiver; the child then takes our call
+	// but never answers it.
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		start = sys_time_msec();
+		while (sys_time_msec() - start < 30)
+			sys_yield();
+		sys_ipc_notify(parent, 0x2);
+		while (1)
+			ipc_recv(NULL, 0, NULL);
+	}
+	if ((r = ipc_recv(&from, 0, 0)) != 0x2 || from != 0)
+		panic("notify wakeup: %x from %08x", r, from);
+	cprintf("notify wakeup ok\n");
+
+	msg.im_value = 0;
+	msg.im_srcva = (void *) UTOP;
+	msg.im_perm = 0;
+	msg.im_npages = 0;
+	msg.im_nwords = 0;
+	start = sys_time_msec();
+	if ((r = ipc_callmsg(child, &msg, NULL, 0, NULL, 30)) != -E_TIMEOUT)
+		panic("timed call returned %d", r);
+	if (sys_time_msec() - start < 30)
+		panic("call timed out after %d ms", sys_time_msec() - start);
+	sys_env_destroy(child);
+	cprintf("call timeout ok\n");
+}
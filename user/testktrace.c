@@ -0,0 +1,71 @@
+// Test kernel event tracing: turn it on, fork a child and send it a
+// message, then look for the events that should have left in the
+// rings.  Must be started by the kernel, since only such environments
+// may use the trace.
+
+#include <inc/lib.h>
+
+#define KTRACEVA	((struct KtraceEvent *) 0xA0000000)
+
+static int ncpus;
+
+// Whether some CPU logged an event of 'type' with first argument 'arg0'.
+static bool
+find_event(int type, uint32_t arg0)
+{
+	struct KtraceEvent *ring, ke;
+	uint32_t seq;
+	int cpu, i;
+
+	for (cpu = 0; cpu < ncpus; cpu++) {
+		ring = KTRACEVA + cpu * KTRACE_NEVENTS;
+		for (i = 0; i < KTRACE_NEVENTS; i++) {
+			if (!(seq = ring[i].ke_seq))
+				continue;
+			ke = ring[i];
+			if (ring[i].ke_seq != seq)
+				continue;
+			if (ke.ke_type == type && ke.ke_arg[0] == arg0)
+				return true;
+		}
+	}
+	return false;
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t child;
+	int r;
+
+	binaryname = "testktrace";
+
+	if ((ncpus = sys_ktrace_map(KTRACEVA)) < 0)
+		panic("sys_ktrace_map: %e", ncpus);
+	if ((r = sys_ktrace(1)) < 0)
+		panic("sys_ktrace: %e", r);
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		// Only the kernel's own environments may use the trace.
+		if ((r = sys_ktrace(0)) != -E_NO_PERM)
+			panic("child sys_ktrace returned %d", r);
+		ipc_recv(NULL, 0, NULL);
+		exit();
+	}
+	ipc_send(child, 1, NULL, 0);
+	wait(child);
+	if ((r = sys_ktrace(0)) < 0)
+		panic("sys_ktrace: %e", r);
+
+	if (!find_event(KT_ENV_CREATE, child))
+		panic("no env_create event for %08x", child);
+	if (!find_event(KT_SWITCH, child))
+		panic("no switch event to %08x", child);
+	if (!find_event(KT_IPC_SEND, child))
+		panic("no ipc_send event to %08x", child);
+	if (!find_event(KT_ENV_DESTROY, child))
+		panic("no env_destroy event for %08x", child);
+	cprintf("ktrace ok\n");
+}
@@ -0,0 +1,69 @@
+// Test the hardware performance counters: a loop of known length
+// should show up in our own counts and the system's.  CPUs without the
+// counters (QEMU without KVM, say) just say so, but a CPU whose CPUID
+// says it counts cycles must have them supported.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NLOOPS	1000000
+
+// Whether CPUID says the CPU counts cycles with Intel's architectural
+// performance monitoring, which is what the kernel looks for.
+static bool
+cpu_counts_cycles(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	// "GenuineIntel", with leaf 0xA.
+	cpuid(0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0xA || ebx != 0x756e6547 || edx != 0x49656e69
+	    || ecx != 0x6c65746e)
+		return false;
+	cpuid(0xA, &eax, &ebx, NULL, NULL);
+	// A version, a counter, and the cycles event not marked missing.
+	return (eax & 0xff) && ((eax >> 8) & 0xff) && (eax >> 24)
+		&& !(ebx & 1);
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct PerfCounts before, after;
+	volatile uint32_t sink = 0;
+	uint64_t instrs;
+	int i, r;
+
+	binaryname = "testperf";
+
+	if ((r = sys_perf_read(0, &before)) == -E_NOT_SUPP) {
+		if (cpu_counts_cycles())
+			panic("CPUID has counters but sys_perf_read says %e", r);
+		cprintf("perf: no counters\n");
+		return;
+	}
+	if (r < 0)
+		panic("sys_perf_read: %e", r);
+	for (i = 0; i < NLOOPS; i++)
+		sink += i;
+	if ((r = sys_perf_read(0, &after)) < 0)
+		panic("sys_perf_read: %e", r);
+
+	// Everything we count, the system counts too.
+	if (after.pc_valid & (1 << PERF_CYCLES)) {
+		if (after.pc_env[PERF_CYCLES] <= before.pc_env[PERF_CYCLES])
+			panic("cycles went from %llu to %llu",
+			      before.pc_env[PERF_CYCLES], after.pc_env[PERF_CYCLES]);
+		if (after.pc_all[PERF_CYCLES] < after.pc_env[PERF_CYCLES])
+			panic("system cycles %llu < ours %llu",
+			      after.pc_all[PERF_CYCLES], after.pc_env[PERF_CYCLES]);
+	}
+	if (after.pc_valid & (1 << PERF_INSTRUCTIONS)) {
+		instrs = after.pc_env[PERF_INSTRUCTIONS]
+			- before.pc_env[PERF_INSTRUCTIONS];
+		if (instrs < NLOOPS)
+			panic("only %llu instructions for %d loops", instrs, NLOOPS);
+	}
+
+	cprintf("perf ok\n");
+}
@@ -0,0 +1,80 @@
+// Test that pipes handing over whole pages keep the data in order and
+// give the reader its own copy (the writer may scribble on its buffer
+// as soon as write returns), and that the kernel only lets the pipe's
+// other end hand pages over, never writable ones.
+
+#include <inc/lib.h>
+
+#define NPAGES	4
+
+char wbuf[NPAGES * PGSIZE] __attribute__ ((aligned(PGSIZE)));
+char rbuf[NPAGES * PGSIZE] __attribute__ ((aligned(PGSIZE)));
+
+static const char hdr[] = "header";
+
+void
+umain(int argc, char **argv)
+{
+	int i, r, p[2];
+	envid_t reader;
+	struct Fd *fd;
+
+	binaryname = "testpipeflip";
+
+	if ((r = pipe(p)) < 0)
+		panic("pipe: %e", r);
+	if ((reader = fork()) < 0)
+		panic("fork: %e", reader);
+
+	if (reader == 0) {
+		close(p[1]);
+		// Hold a window open while the writer tries to abuse it.
+		fd_lookup(p[0], &fd);
+		if ((r = sys_page_accept(rbuf, sizeof(rbuf), fd2data(fd))) < 0)
+			panic("sys_page_accept: %e", r);
+		ipc_send(thisenv->env_parent_id, 0, NULL, 0);
+		ipc_recv(NULL, NULL, NULL);
+		sys_page_accept(0, 0, 0);
+		for (i = 0; i < 2; i++) {
+			// An unaligned bit through the ring, then whole pages.
+			if ((r = readn(p[0], rbuf, sizeof(hdr))) != sizeof(hdr)
+			    || strcmp(rbuf, hdr) != 0)
+				panic("read header: %d", r);
+			if ((r = readn(p[0], rbuf, sizeof(rbuf))) != sizeof(rbuf))
+				panic("read pages: %d", r);
+			for (r = 0; r < sizeof(rbuf); r++)
+				if (rbuf[r] != (char) (r / PGSIZE + i))
+					panic("round %d: byte %d is %d", i, r, rbuf[r]);
+			// Our copy must be writable, too.
+			memset(rbuf, 0, sizeof(rbuf));
+		}
+		if ((r = read(p[0], rbuf, sizeof(rbuf))) != 0)
+			panic("read at eof: %d", r);
+		cprintf("pipe flip ok\n");
+		exit();
+	}
+
+	close(p[0]);
+	ipc_recv(NULL, NULL, NULL);
+	wbuf[0] = 0;
+	if ((r = sys_page_flip(wbuf, reader, rbuf, wbuf, PTE_P|PTE_U)) != -E_BAD_ENV)
+		panic("flip without the pipe's page: %d", r);
+	fd_lookup(p[1], &fd);
+	if ((r = sys_page_flip(wbuf, reader, rbuf, fd2data(fd),
+			       PTE_P|PTE_U|PTE_W)) != -E_INVAL)
+		panic("writable flip: %d", r);
+	ipc_send(reader, 0, NULL, 0);
+
+	for (i = 0; i < 2; i++) {
+		for (r = 0; r < sizeof(wbuf); r++)
+			wbuf[r] = r / PGSIZE + i;
+		if ((r = write(p[1], hdr, sizeof(hdr))) != sizeof(hdr))
+			panic("write header: %d", r);
+		if ((r = write(p[1], wbuf, sizeof(wbuf))) != sizeof(wbuf))
+			panic("write pages: %d", r);
+		// The reader must not see this.
+		memset(wbuf, 0xff, sizeof(wbuf));
+	}
+	close(p[1]);
+	wait(reader);
+}
@@ -0,0 +1,61 @@
+// Test poll() on pipes: waiting on several at once, timeouts, and eof.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	int a[2], b[2], r;
+	envid_t child;
+	struct PollFd pf[2];
+	unsigned start;
+	char c;
+
+	binaryname = "testpoll";
+
+	if ((r = pipe(a)) < 0 || (r = pipe(b)) < 0)
+		panic("pipe: %e", r);
+
+	// Only the second pipe gets data, and only after a while.
+	if ((r = fork()) < 0)
+		panic("fork: %e", r);
+	if (r == 0) {
+		close(a[0]);
+		close(b[0]);
+		poll(0, 0, 50);
+		write(b[1], "b", 1);
+		exit();
+	}
+	child = r;
+	close(b[1]);
+
+	pf[0].pf_fd = a[0];
+	pf[0].pf_events = POLLIN;
+	pf[1].pf_fd = b[0];
+	pf[1].pf_events = POLLIN;
+	if ((r = poll(pf, 2, -1)) != 1)
+		panic("poll returned %d, want 1", r);
+	if (pf[0].pf_revents != 0 || !(pf[1].pf_revents & POLLIN))
+		panic("poll revents %x %x", pf[0].pf_revents, pf[1].pf_revents);
+	if ((r = read(b[0], &c, 1)) != 1 || c != 'b')
+		panic("read: %d", r);
+	cprintf("poll wakeup ok\n");
+
+	// Nothing more will come down 'a' while we hold its write end.
+	start = sys_time_msec();
+	if ((r = poll(pf, 1, 30)) != 0)
+		panic("poll returned %d, want timeout", r);
+	if (sys_time_msec() - start < 30)
+		panic("poll timed out after %d ms", sys_time_msec() - start);
+	cprintf("poll timeout ok\n");
+
+	// Once the child is gone 'b' reports eof; closing 'a' does the same.
+	wait(child);
+	close(a[1]);
+	pf[0].pf_fd = a[0];
+	if ((r = poll(pf, 2, -1)) != 2
+	    || !(pf[0].pf_revents & POLLHUP) || !(pf[1].pf_revents & POLLHUP))
+		panic("poll at eof: %d %x %x", r, pf[0].pf_revents,
+		      pf[1].pf_revents);
+	cprintf("poll eof ok\n");
+}
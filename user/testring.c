@@ -0,0 +1,98 @@
+// Test asynchronous system calls: queued page operations complete in
+// order on the next trap, calls that aren't allowed fail, nothing runs
+// while someone else could write the ring, and queued sends wait for
+// their receiver.
+
+#include <inc/lib.h>
+
+#define RINGVA	((void *) 0xA0000000)
+#define VA1	((void *) 0xA0001000)
+#define VA2	((void *) 0xA0002000)
+#define VA3	((void *) 0xA0003000)
+#define NSENDS	(2 * RING_NSLOTS)
+
+static bool
+mapped(void *va)
+{
+	return (uvpd[PDX(va)] & PTE_P) && (uvpt[PGNUM(va)] & PTE_P);
+}
+
+static void
+expect(uint32_t data, int ret)
+{
+	struct RingCqe *cqe;
+
+	if (!(cqe = ring_peek_cqe()))
+		panic("no completion for request %d", data);
+	if (cqe->cqe_data != data || cqe->cqe_ret != ret)
+		panic("completion %d returned %d, want %d returning %d",
+		      cqe->cqe_data, cqe->cqe_ret, data, ret);
+	ring_cqe_seen();
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t child;
+	int i, done, r;
+
+	binaryname = "testring";
+
+	if ((r = ring_init(RINGVA)) < 0)
+		panic("ring_init: %e", r);
+
+	ring_prep(SYS_page_alloc, 0, (uint32_t) VA1, PTE_P|PTE_U|PTE_W, 0, 0, 1);
+	ring_prep(SYS_page_map, 0, (uint32_t) VA1, 0, (uint32_t) VA2,
+		  PTE_P|PTE_U|PTE_W, 2);
+	ring_prep(SYS_page_unmap, 0, (uint32_t) VA1, 0, 0, 0, 3);
+	ring_prep(SYS_yield, 0, 0, 0, 0, 0, 4);
+	// Any trap will do.
+	sys_getenvid();
+	expect(1, 0);
+	expect(2, 0);
+	expect(3, 0);
+	expect(4, -E_INVAL);
+	if (ring_peek_cqe())
+		panic("extra completion");
+	if (mapped(VA1) || !mapped(VA2))
+		panic("ring left the wrong pages mapped");
+	cprintf("ring pages ok\n");
+
+	// With the ring mapped twice, requests wait until it isn't.
+	if ((r = sys_page_map(0, RINGVA, 0, VA3, PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_map: %e", r);
+	ring_prep(SYS_page_unmap, 0, (uint32_t) VA2, 0, 0, 0, 5);
+	sys_getenvid();
+	if (ring_peek_cqe())
+		panic("ring ran while mapped twice");
+	sys_page_unmap(0, VA3);
+	sys_getenvid();
+	expect(5, 0);
+	cprintf("ring owner ok\n");
+
+	// More sends than the ring holds, to a child that checks they
+	// arrive in order.
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		if (mapped(RINGVA))
+			panic("child got its parent's ring");
+		for (i = 0; i < NSENDS; i++)
+			if ((r = ipc_recv(NULL, 0, 0)) != i)
+				panic("send %d arrived as %d", i, r);
+		ipc_send(thisenv->env_parent_id, 0, 0, 0);
+		exit();
+	}
+	for (i = done = 0; done < NSENDS; ) {
+		if (i < NSENDS
+		    && ring_prep(SYS_ipc_try_send, child, i, UTOP, 0, 0, i) == 0) {
+			i++;
+			continue;
+		}
+		ring_wait_cqe();
+		expect(done++, 0);
+	}
+	ipc_recv(NULL, 0, 0);
+	wait(child);
+	cprintf("ring send ok\n");
+}
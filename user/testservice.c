@@ -0,0 +1,44 @@
+// Test the service registry: names resolve to their server, can't be
+// taken twice, go away with the server, and the file server's name
+// can't be taken by anyone else.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	envid_t child, env;
+	int r;
+
+	binaryname = "testservice";
+
+	if ((r = sys_service_register("testservice")) < 0)
+		panic("register: %e", r);
+	if ((env = ipc_lookup("testservice")) != thisenv->env_id)
+		panic("lookup found %08x, want %08x", env, thisenv->env_id);
+	if ((r = sys_service_lookup("no such service")) != -E_NOT_FOUND)
+		panic("lookup of a missing name: %e", r);
+	if ((r = sys_service_register("fs")) != -E_BAD_ENV)
+		panic("registered the file server's name: %e", r);
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		if ((r = sys_service_register("testservice")) != -E_NAME_EXISTS)
+			panic("registered a taken name: %e", r);
+		if ((r = sys_service_register("testservice child")) < 0)
+			panic("register: %e", r);
+		ipc_recv(NULL, NULL, NULL);
+		exit();
+	}
+
+	while ((env = ipc_lookup("testservice child")) == 0)
+		sys_yield();
+	if (env != child)
+		panic("lookup found %08x, want %08x", env, child);
+	ipc_send(child, 0, NULL, 0);
+	wait(child);
+	if ((env = ipc_lookup("testservice child")) != 0)
+		panic("name outlived its server: %08x", env);
+	cprintf("service registry ok\n");
+}
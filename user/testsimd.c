@@ -0,0 +1,115 @@
+// Test that x87 and SSE registers survive preemption: several
+// environments load their own values into the FPU and each pick their
+// own rounding mode, spin until they have been preempted a few times and
+// have yielded to each other, then check that the values are still there
+// and that arithmetic still rounds their way.  Then do the same across
+// blocking in ipc_recv, which may let our CPU halt and wake us up on
+// another.
+
+#include <inc/lib.h>
+
+#define NCHILD		2
+#define NPREEMPT	5
+#define NYIELD		20
+
+// Load FPU values and a rounding mode that depend on 'seed', then spin,
+// or block in ipc_recv if 'block', and check that they are still there.
+static void
+check_fpu(uint32_t seed, bool block)
+{
+	uint32_t in[32], out[32], start, spins;
+	int i, x87, yields;
+	uint16_t cw;
+	volatile double one = 1.0, three = 3.0, before, after;
+
+	for (i = 0; i < 32; i++)
+		in[i] = seed * 0x01010101 + i;
+	__asm __volatile("movups 0(%0),%%xmm0\n"
+			 "\tmovups 16(%0),%%xmm1\n"
+			 "\tmovups 32(%0),%%xmm2\n"
+			 "\tmovups 48(%0),%%xmm3\n"
+			 "\tmovups 64(%0),%%xmm4\n"
+			 "\tmovups 80(%0),%%xmm5\n"
+			 "\tmovups 96(%0),%%xmm6\n"
+			 "\tmovups 112(%0),%%xmm7\n"
+			 "\tfildl %1\n"
+			 : : "r" (in), "m" (seed) : "memory");
+	// 1/3 comes out differently rounding up than to nearest or down.
+	__asm __volatile("fnstcw %0" : "=m" (cw));
+	cw = (cw & ~0xc00) | (seed % 4) << 10;
+	__asm __volatile("fldcw %0" : : "m" (cw));
+	before = one / three;
+
+	if (block)
+		ipc_recv(NULL, 0, NULL);
+	else {
+		start = vdso.vd_preempts;
+		for (spins = yields = 0;
+		     vdso.vd_preempts - start < NPREEMPT || yields < NYIELD;
+		     spins++)
+			if (spins % 100000 == 0) {
+				sys_yield();
+				yields++;
+			}
+	}
+
+	after = one / three;
+	if (after != before)
+		panic("env %08x: 1/3 rounds differently after %s",
+		      getenvid(), block ? "blocking" : "spinning");
+
+	__asm __volatile("fistpl %0\n"
+			 "\tmovups %%xmm0,0(%1)\n"
+			 "\tmovups %%xmm1,16(%1)\n"
+			 "\tmovups %%xmm2,32(%1)\n"
+			 "\tmovups %%xmm3,48(%1)\n"
+			 "\tmovups %%xmm4,64(%1)\n"
+			 "\tmovups %%xmm5,80(%1)\n"
+			 "\tmovups %%xmm6,96(%1)\n"
+			 "\tmovups %%xmm7,112(%1)\n"
+			 : "=m" (x87) : "r" (out) : "memory");
+
+	if (x87 != seed)
+		panic("env %08x: st(0) is %d, want %d", getenvid(), x87, seed);
+	for (i = 0; i < 32; i++)
+		if (out[i] != in[i])
+			panic("env %08x: xmm%d word %d is %08x, want %08x",
+			      getenvid(), i / 4, i % 4, out[i], in[i]);
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t kids[NCHILD], kid;
+	int i;
+
+	binaryname = "testsimd";
+
+	for (i = 0; i < NCHILD; i++) {
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %e", kids[i]);
+		if (kids[i] == 0) {
+			check_fpu(i + 1, false);
+			exit();
+		}
+	}
+	check_fpu(NCHILD + 1, false);
+	for (i = 0; i < NCHILD; i++)
+		wait(kids[i]);
+	// A child that failed would have panicked instead of exiting.
+	cprintf("simd ok\n");
+
+	// A child blocks holding FPU values while we use the FPU ourselves.
+	if ((kid = fork()) < 0)
+		panic("fork: %e", kid);
+	if (kid == 0) {
+		check_fpu(2, true);
+		exit();
+	}
+	while (envs[ENVX(kid)].env_status != ENV_NOT_RUNNABLE)
+		sys_yield();
+	check_fpu(NCHILD + 2, false);
+	ipc_send(kid, 0, NULL, 0);
+	wait(kid);
+	cprintf("simd blocking ok\n");
+}
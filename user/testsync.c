@@ -0,0 +1,80 @@
+// Test futex-based mutexes and condition variables across environments.
+
+#include <inc/lib.h>
+
+#define NCHILD	4
+#define NITER	200
+
+struct Shared {
+	struct Mutex lock;
+	struct Cond nonempty;
+	int counter;
+	int items;
+};
+
+static struct Shared *shared = (struct Shared *) 0x0ffff000;
+
+void
+umain(int argc, char **argv)
+{
+	envid_t kids[NCHILD];
+	int i, j, r;
+
+	if ((r = sys_page_alloc(0, shared, PTE_P|PTE_U|PTE_W|PTE_SHARE)) < 0)
+		panic("sys_page_alloc: %e", r);
+	mutex_init(&shared->lock);
+	cond_init(&shared->nonempty);
+
+	// Several children hammer a counter; yielding inside the critical
+	// section forces the others onto the futex wait queue.
+	for (i = 0; i < NCHILD; i++) {
+		if ((r = fork()) < 0)
+			panic("fork: %e", r);
+		if (r == 0) {
+			for (j = 0; j < NITER; j++) {
+				mutex_lock(&shared->lock);
+				int c = shared->counter;
+				if (j % 16 == 0)
+					sys_yield();
+				shared->counter = c + 1;
+				mutex_unlock(&shared->lock);
+			}
+			exit();
+		}
+		kids[i] = r;
+	}
+	for (i = 0; i < NCHILD; i++)
+		wait(kids[i]);
+	if (shared->counter != NCHILD * NITER)
+		panic("mutex: counter is %d, want %d",
+		      shared->counter, NCHILD * NITER);
+	cprintf("mutex ok\n");
+
+	// One consumer sleeps on a condition variable until the producer
+	// (us) has handed over every item.
+	if ((r = fork()) < 0)
+		panic("fork: %e", r);
+	if (r == 0) {
+		for (i = 0; i < NITER; i++) {
+			mutex_lock(&shared->lock);
+			while (shared->items == 0)
+				cond_wait(&shared->nonempty, &shared->lock);
+			shared->items--;
+			mutex_unlock(&shared->lock);
+		}
+		exit();
+	}
+	kids[0] = r;
+	for (i = 0; i < NITER; i++) {
+		mutex_lock(&shared->lock);
+		shared->items++;
+		cond_signal(&shared->nonempty);
+		mutex_unlock(&shared->lock);
+		if (i % 8 == 0)
+			sys_yield();
+	}
+	wait(kids[0]);
+	if (shared->items != 0)
+		panic("cond: %d items left over", shared->items);
+	cprintf("cond ok\n");
+}
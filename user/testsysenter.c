@@ -0,0 +1,68 @@
+// Test that the flags a user environment enters the kernel with through
+// sysenter don't upset it: a sysenter with TF set single-steps into the
+// kernel, and NT and AC ride along into it, and each call must still
+// come back with the right answer.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+// sys_getenvid through sysenter, with 'flags' or'd into %eflags for the
+// call.  Returns the call's result and, in *after, the flags it came
+// back with.  The popfl must come right before the sysenter, since TF
+// takes effect after the instruction following it.
+static envid_t
+getenvid_flags(uint32_t flags, uint32_t *after)
+{
+	envid_t ret;
+
+	asm volatile("pushl %%ebp\n"
+		"\tpushfl\n"
+		"\torl %3,(%%esp)\n"
+		"\tleal 4(%%esp),%%ebp\n"
+		"\tleal 1f,%%esi\n"
+		"\tpopfl\n"
+		"\tsysenter\n"
+		"1:\tpushfl\n"
+		"\tpopl %1\n"
+		"\tpushfl\n"
+		"\tandl %4,(%%esp)\n"
+		"\tpopfl\n"
+		"\tpopl %%ebp\n"
+		: "=a" (ret), "=&d" (*after)
+		: "a" (SYS_getenvid), "b" (flags),
+		  "i" (~(FL_TF|FL_NT|FL_AC))
+		: "ecx", "esi", "cc", "memory");
+	return ret;
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t edx, after;
+	envid_t id;
+
+	binaryname = "testsysenter";
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (!(edx & CPUID_FEAT_SEP)) {
+		cprintf("testsysenter: no sysenter\n");
+		return;
+	}
+
+	// TF: the #DB arrives in the kernel, which must swallow it.  The
+	// user's TF doesn't survive the call.
+	if ((id = getenvid_flags(FL_TF, &after)) != thisenv->env_id)
+		panic("sysenter with TF returned %08x", id);
+
+	// NT and AC have no effect in the kernel, and come back as they were.
+	if ((id = getenvid_flags(FL_NT, &after)) != thisenv->env_id)
+		panic("sysenter with NT returned %08x", id);
+	if (!(after & FL_NT))
+		panic("sysenter lost NT: eflags %08x", after);
+	if ((id = getenvid_flags(FL_AC, &after)) != thisenv->env_id)
+		panic("sysenter with AC returned %08x", id);
+	if (!(after & FL_AC))
+		panic("sysenter lost AC: eflags %08x", after);
+
+	cprintf("testsysenter ok\n");
+}
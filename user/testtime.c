@@ -0,0 +1,42 @@
+// Test the nanosecond clock: the system call and the clock page agree,
+// neither goes backwards, and both keep time with the clock tick.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t a, b, c, ns;
+	unsigned start, ms;
+	int i;
+
+	binaryname = "testtime";
+
+	if (!timepage.tp_tsc_khz)
+		panic("clock page not set up");
+	cprintf("TSC runs at %u kHz\n", timepage.tp_tsc_khz);
+
+	for (i = 0; i < 1000; i++) {
+		a = sys_time_nsec();
+		b = time_nsec();
+		c = sys_time_nsec();
+		if (b < a || c < b)
+			panic("clock went backwards: %llu %llu %llu", a, b, c);
+	}
+	cprintf("time monotonic ok\n");
+
+	// Wait out 100 ms of ticks, from just after a tick.
+	start = sys_time_msec();
+	while (sys_time_msec() == start)
+		sys_yield();
+	start = sys_time_msec();
+	a = time_nsec();
+	while (sys_time_msec() - start < 100)
+		sys_yield();
+	ms = sys_time_msec() - start;
+	ns = time_nsec() - a;
+	// Allow a tick either way, and then some for the yields.
+	if (ns < (ms - 10) * 1000000ULL || ns > (ms + 20) * 1000000ULL)
+		panic("%u ms of ticks took %llu ns", ms, ns);
+	cprintf("time rate ok\n");
+}
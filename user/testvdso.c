@@ -0,0 +1,63 @@
+// Test the per-environment data page at UVDSO: it agrees with the
+// system calls and envs[], each child gets its own, and it stays
+// read-only.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NITER	1000
+
+static void
+check(const char *who)
+{
+	uint32_t runs;
+
+	if (getenvid() != sys_getenvid())
+		panic("%s: getenvid %08x, sys_getenvid %08x",
+		      who, getenvid(), sys_getenvid());
+	if (vdso.vd_parent_id != thisenv->env_parent_id)
+		panic("%s: parent %08x, want %08x",
+		      who, vdso.vd_parent_id, thisenv->env_parent_id);
+	if (getcpu() != thisenv->env_cpunum)
+		panic("%s: cpu %d, want %d", who, getcpu(), thisenv->env_cpunum);
+	runs = vdso.vd_runs;
+	sys_yield();
+	if (vdso.vd_runs == runs)
+		panic("%s: run count stuck at %d", who, runs);
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t child;
+	uint64_t start, fast, slow;
+	int i, r;
+
+	binaryname = "testvdso";
+
+	check("parent");
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		check("child");
+		exit();
+	}
+	wait(child);
+	cprintf("vdso ids ok\n");
+
+	if ((r = sys_page_map(0, (void *) UVDSO, 0, UTEMP,
+			      PTE_P|PTE_U|PTE_W)) != -E_INVAL)
+		panic("mapped the vdso page writable: %d", r);
+	cprintf("vdso read-only ok\n");
+
+	start = read_tsc();
+	for (i = 0; i < NITER; i++)
+		getenvid();
+	fast = read_tsc() - start;
+	start = read_tsc();
+	for (i = 0; i < NITER; i++)
+		sys_getenvid();
+	slow = read_tsc() - start;
+	cprintf("getenvid %llu cycles, sys_getenvid %llu cycles\n",
+		fast / NITER, slow / NITER);
+}